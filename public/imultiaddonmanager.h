@@ -19,7 +19,19 @@
 
 #pragma once
 
-#define MULTIADDONMANAGER_INTERFACE "MultiAddonManager003"
+#define MULTIADDONMANAGER_INTERFACE "MultiAddonManager004"
+
+// Progress of all addon downloads, in progress or queued
+struct AddonDownloadProgress_t
+{
+	int nDownloads; // In progress or queued
+	int nInProgress;
+	uint64 nBytesDownloaded;
+	uint64 nTotalBytes; // Only downloads Steam already knows the size of
+	double flBytesPerSecond; // Moving average over the last few seconds
+	double flSecondsRemaining; // Until the downloads the next map reload waits on (or all of them if none) are done, -1 if unknown
+};
+
 class IMultiAddonManager
 {
 public:
@@ -54,4 +66,8 @@ public:
 	virtual void AddClientAddon(const char *pszAddon, uint64 steamID64 = 0, bool bRefresh = false) = 0;
 	virtual void RemoveClientAddon(const char *pszAddon, uint64 steamID64 = 0) = 0;
 	virtual void ClearClientAddons(uint64 steamID64 = 0) = 0;
+
+	// Added in MultiAddonManager004
+	// Fill in the progress of all addon downloads, returns false if there are none
+	virtual bool GetDownloadProgress(AddonDownloadProgress_t *pProgress) = 0;
 };
@@ -0,0 +1,314 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "addonregistry.h"
+#include "strtools.h"
+#include "tier0/dbg.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "tier0/memdbgon.h"
+
+CAddonRegistry g_AddonRegistry;
+
+bool CAddonRegistry::ParseWorkshopID(const char *pszAddon, PublishedFileId_t &addon)
+{
+	addon = 0;
+
+	const char *pszEnd = pszAddon;
+	while (*pszEnd >= '0' && *pszEnd <= '9')
+		pszEnd++;
+
+	if (pszEnd == pszAddon || *pszEnd)
+		return false;
+
+	// UINT64_MAX has 20 digits, anything longer can't fit
+	if (pszEnd - pszAddon > 20)
+		return true;
+
+	PublishedFileId_t nValue = 0;
+
+	for (const char *p = pszAddon; p < pszEnd; p++)
+	{
+		PublishedFileId_t nDigit = *p - '0';
+
+		if (nValue > (UINT64_MAX - nDigit) / 10)
+			return true;
+
+		nValue = nValue * 10 + nDigit;
+	}
+
+	// Don't let a bogus ID collide with the named addon range
+	if (!(nValue & k_nNamedAddonFlag))
+		addon = nValue;
+
+	return true;
+}
+
+PublishedFileId_t CAddonRegistry::Intern(const char *pszAddon)
+{
+	if (!pszAddon || !*pszAddon)
+		return 0;
+
+	PublishedFileId_t addon;
+
+	if (!ParseWorkshopID(pszAddon, addon))
+	{
+		const RegistryData_t *pData = m_Data.Get();
+		auto it = pData->m_NamedAddons.find(pszAddon);
+
+		if (it != pData->m_NamedAddons.end())
+			return it->second;
+
+		addon = k_nNamedAddonFlag | (pData->m_NamedAddons.size() + 1);
+		Insert(addon, pszAddon);
+
+		return addon;
+	}
+
+	if (addon)
+		GetSlot(addon);
+
+	return addon;
+}
+
+int CAddonRegistry::Insert(PublishedFileId_t addon, const char *pszName)
+{
+	RegistryData_t *pData = new RegistryData_t(*m_Data.Get());
+	int iSlot = (int)pData->m_Entries.size();
+
+	pData->m_Entries.push_back({ addon, pszName });
+	pData->m_SlotByAddon.emplace(addon, iSlot);
+
+	if (!IsWorkshopAddon(addon))
+		pData->m_NamedAddons.emplace(pszName, addon);
+
+	m_Data.Publish(pData);
+
+	return iSlot;
+}
+
+PublishedFileId_t CAddonRegistry::Find(const char *pszAddon) const
+{
+	if (!pszAddon || !*pszAddon)
+		return 0;
+
+	PublishedFileId_t addon;
+
+	if (ParseWorkshopID(pszAddon, addon))
+		return addon;
+
+	const RegistryData_t *pData = m_Data.Get();
+	auto it = pData->m_NamedAddons.find(pszAddon);
+
+	return it != pData->m_NamedAddons.end() ? it->second : 0;
+}
+
+int CAddonRegistry::GetSlot(PublishedFileId_t addon)
+{
+	int iSlot = FindSlot(addon);
+
+	if (iSlot != -1 || !IsWorkshopAddon(addon))
+		return iSlot;
+
+	char szName[32];
+	V_snprintf(szName, sizeof(szName), "%llu", addon);
+
+	return Insert(addon, szName);
+}
+
+int CAddonRegistry::FindSlot(PublishedFileId_t addon) const
+{
+	const RegistryData_t *pData = m_Data.Get();
+	auto it = pData->m_SlotByAddon.find(addon);
+
+	return it != pData->m_SlotByAddon.end() ? it->second : -1;
+}
+
+const char *CAddonRegistry::GetName(PublishedFileId_t addon) const
+{
+	const RegistryData_t *pData = m_Data.Get();
+	auto it = pData->m_SlotByAddon.find(addon);
+
+	return it != pData->m_SlotByAddon.end() ? pData->m_Entries[it->second].m_sName.c_str() : "";
+}
+
+void CAddonBitSet::Set(int iSlot)
+{
+	if (iSlot < 0)
+		return;
+
+	size_t nWord = iSlot / 64;
+
+	if (m_Words.size() <= nWord)
+		m_Words.resize(nWord + 1);
+
+	m_Words[nWord] |= 1ull << (iSlot % 64);
+}
+
+void CAddonBitSet::Clear(int iSlot)
+{
+	if (iSlot < 0 || (size_t)iSlot / 64 >= m_Words.size())
+		return;
+
+	m_Words[iSlot / 64] &= ~(1ull << (iSlot % 64));
+}
+
+bool CAddonBitSet::IsSet(int iSlot) const
+{
+	if (iSlot < 0 || (size_t)iSlot / 64 >= m_Words.size())
+		return false;
+
+	return (m_Words[iSlot / 64] >> (iSlot % 64)) & 1;
+}
+
+void CAddonBitSet::AndNot(const CAddonBitSet &other)
+{
+	size_t nWords = MIN(m_Words.size(), other.m_Words.size());
+
+	for (size_t i = 0; i < nWords; i++)
+		m_Words[i] &= ~other.m_Words[i];
+}
+
+bool CAddonBitSet::IsEmpty() const
+{
+	for (uint64 nWord : m_Words)
+	{
+		if (nWord)
+			return false;
+	}
+
+	return true;
+}
+
+int CAddonBitSet::Count() const
+{
+	int nCount = 0;
+
+	for (uint64 nWord : m_Words)
+		nCount += PopCount(nWord);
+
+	return nCount;
+}
+
+bool CAddonList::AddToTail(PublishedFileId_t addon)
+{
+	if (!addon || m_Set.Has(addon))
+		return false;
+
+	m_Set.Add(addon);
+	m_Addons.push_back(addon);
+	return true;
+}
+
+bool CAddonList::AddToHead(PublishedFileId_t addon)
+{
+	if (!addon || m_Set.Has(addon))
+		return false;
+
+	m_Set.Add(addon);
+	m_Addons.insert(m_Addons.begin(), addon);
+	return true;
+}
+
+void CAddonList::AddListToTail(const CAddonList &other)
+{
+	for (PublishedFileId_t addon : other.m_Addons)
+		AddToTail(addon);
+}
+
+bool CAddonList::Remove(PublishedFileId_t addon)
+{
+	if (!m_Set.Has(addon))
+		return false;
+
+	m_Set.Remove(addon);
+	m_Addons.erase(std::find(m_Addons.begin(), m_Addons.end(), addon));
+	return true;
+}
+
+void CAddonList::RemoveAll()
+{
+	m_Addons.clear();
+	m_Set.ClearAll();
+}
+
+PublishedFileId_t CAddonList::FindFirstMissing(const CAddonBitSet &set) const
+{
+	for (PublishedFileId_t addon : m_Addons)
+	{
+		if (!set.Has(addon))
+			return addon;
+	}
+
+	return 0;
+}
+
+void CAddonList::FromString(const char *pszAddons)
+{
+	RemoveAll();
+
+	if (!pszAddons)
+		return;
+
+	char szAddon[256];
+
+	while (*pszAddons)
+	{
+		const char *pszEnd = strchr(pszAddons, ',');
+		size_t nLength = pszEnd ? pszEnd - pszAddons : strlen(pszAddons);
+
+		if (nLength && nLength < sizeof(szAddon))
+		{
+			memcpy(szAddon, pszAddons, nLength);
+			szAddon[nLength] = '\0';
+
+			if (PublishedFileId_t addon = g_AddonRegistry.Intern(szAddon))
+				AddToTail(addon);
+			else
+				Warning("[MultiAddonManager] Skipping invalid addon %s\n", szAddon);
+		}
+		else if (nLength)
+		{
+			// Too long to be an addon ID or name
+			Warning("[MultiAddonManager] Skipping invalid addon %.*s\n", (int)nLength, pszAddons);
+		}
+
+		if (!pszEnd)
+			break;
+
+		pszAddons = pszEnd + 1;
+	}
+}
+
+std::string CAddonList::ToString() const
+{
+	std::string result;
+
+	for (size_t i = 0; i < m_Addons.size(); i++)
+	{
+		if (i > 0)
+			result += ',';
+
+		result += g_AddonRegistry.GetName(m_Addons[i]);
+	}
+
+	return result;
+}
@@ -0,0 +1,166 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "utlvector.h"
+#include "steam/steamclientpublic.h"
+#include "utils/rcu.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+// Addons that aren't workshop IDs (e.g. community maps living in OFFICIAL_ADDONS) get a synthetic handle with this bit set
+constexpr PublishedFileId_t k_nNamedAddonFlag = 1ull << 63;
+
+// Every addon the plugin deals with is interned here once, at the convar/interface boundary.
+// Internally addons are then passed around as PublishedFileId_t handles, and each handle is also given a dense slot index
+// which never changes for the lifetime of the plugin, so per-addon state can be kept in flat arrays.
+// Interning only happens on the main thread, lookups are safe from any thread inside a CRcuReadScope.
+class CAddonRegistry
+{
+public:
+	CAddonRegistry() { m_Data.Publish(new RegistryData_t); }
+
+	// Returns the handle of the given addon string, interning it if necessary.
+	// Returns 0 for empty or invalid strings, such as a number too big to be a workshop ID.
+	PublishedFileId_t Intern(const char *pszAddon);
+
+	// Same as Intern but never inserts anything, returns 0 if the addon is unknown
+	PublishedFileId_t Find(const char *pszAddon) const;
+
+	// Returns the slot of the given handle, interning it if necessary (only valid for workshop IDs)
+	int GetSlot(PublishedFileId_t addon);
+
+	// Returns the slot of the given handle, or -1 if it was never interned
+	int FindSlot(PublishedFileId_t addon) const;
+
+	// The string form of an interned addon, as expected by the engine
+	const char *GetName(PublishedFileId_t addon) const;
+
+	PublishedFileId_t GetAddon(int iSlot) const { return m_Data.Get()->m_Entries[iSlot].m_nAddon; }
+	int Count() const { return (int)m_Data.Get()->m_Entries.size(); }
+
+	static bool IsWorkshopAddon(PublishedFileId_t addon) { return addon && !(addon & k_nNamedAddonFlag); }
+
+private:
+	// Returns false if the string isn't made of digits, i.e. it's a named addon.
+	// Otherwise addon is the workshop ID, or 0 if the number can't be one (overflowing, or in the named addon range).
+	static bool ParseWorkshopID(const char *pszAddon, PublishedFileId_t &addon);
+
+	struct AddonEntry_t
+	{
+		PublishedFileId_t m_nAddon;
+		std::string m_sName;
+	};
+
+	// Copied and republished whenever an addon is interned, which only happens a handful of times
+	struct RegistryData_t
+	{
+		std::vector<AddonEntry_t> m_Entries;
+		std::unordered_map<PublishedFileId_t, int> m_SlotByAddon;
+		std::unordered_map<std::string, PublishedFileId_t> m_NamedAddons;
+	};
+
+	int Insert(PublishedFileId_t addon, const char *pszName);
+
+	CRcuPointer<RegistryData_t> m_Data;
+};
+
+extern CAddonRegistry g_AddonRegistry;
+
+// Dense set of addons indexed by registry slot
+class CAddonBitSet
+{
+public:
+	void Set(int iSlot);
+	void Clear(int iSlot);
+	bool IsSet(int iSlot) const;
+	void ClearAll() { m_Words.clear(); }
+
+	// Convenience wrappers taking addon handles, interning them if needed
+	void Add(PublishedFileId_t addon) { Set(g_AddonRegistry.GetSlot(addon)); }
+	void Remove(PublishedFileId_t addon) { Clear(g_AddonRegistry.FindSlot(addon)); }
+	bool Has(PublishedFileId_t addon) const { return IsSet(g_AddonRegistry.FindSlot(addon)); }
+
+	// this &= ~other
+	void AndNot(const CAddonBitSet &other);
+
+	bool IsEmpty() const;
+	int Count() const;
+
+	size_t GetMemoryUsage() const { return m_Words.capacity() * sizeof(uint64); }
+
+private:
+	static int PopCount(uint64 nWord)
+	{
+#ifdef _WIN32
+		return (int)__popcnt64(nWord);
+#else
+		return __builtin_popcountll(nWord);
+#endif
+	}
+
+	std::vector<uint64> m_Words;
+};
+
+// Ordered list of unique addons with constant time membership checks, cheap to copy around
+class CAddonList
+{
+public:
+	bool AddToTail(PublishedFileId_t addon);
+	bool AddToHead(PublishedFileId_t addon);
+	// Append all addons of another list, skipping duplicates
+	void AddListToTail(const CAddonList &other);
+	bool Remove(PublishedFileId_t addon);
+	void RemoveAll();
+
+	bool Has(PublishedFileId_t addon) const { return m_Set.Has(addon); }
+	// Same addons in the same order
+	bool operator==(const CAddonList &other) const { return m_Addons == other.m_Addons; }
+	bool operator!=(const CAddonList &other) const { return m_Addons != other.m_Addons; }
+	int Count() const { return (int)m_Addons.size(); }
+	bool IsEmpty() const { return m_Addons.empty(); }
+	PublishedFileId_t Head() const { return m_Addons.front(); }
+	PublishedFileId_t operator[](int i) const { return m_Addons[i]; }
+	const std::vector<PublishedFileId_t> &GetAddons() const { return m_Addons; }
+
+	// The membership of this list as a bitset, ready for set operations against per-client state
+	const CAddonBitSet &GetSet() const { return m_Set; }
+
+	// Returns the first addon of this list which isn't in the given set, or 0 if there is none
+	PublishedFileId_t FindFirstMissing(const CAddonBitSet &set) const;
+
+	// Parse a comma separated list of addons, interning all of them
+	void FromString(const char *pszAddons);
+
+	// Build the comma separated string the engine expects
+	std::string ToString() const;
+
+	// Heap memory owned by this list
+	size_t GetMemoryUsage() const { return m_Addons.capacity() * sizeof(PublishedFileId_t) + m_Set.GetMemoryUsage(); }
+
+private:
+	std::vector<PublishedFileId_t> m_Addons;
+	CAddonBitSet m_Set;
+};
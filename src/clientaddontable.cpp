@@ -0,0 +1,263 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clientaddontable.h"
+
+#include "tier0/memdbgon.h"
+
+CClientAddonTable g_ClientAddons;
+
+CClientAddonTable::~CClientAddonTable()
+{
+	for (Shard_t &shard : m_Shards)
+	{
+		SlotArray_t *pSlots = shard.m_pSlots.load();
+		if (!pSlots)
+			continue;
+
+		for (std::atomic<ClientAddonInfo_t *> &slot : pSlots->m_Slots)
+			delete slot.load();
+
+		delete pSlots;
+	}
+}
+
+uint64 CClientAddonTable::Hash(uint64 steamID64)
+{
+	// SteamIDs share their upper bits, so mix everything down (splitmix64 finalizer)
+	steamID64 ^= steamID64 >> 30;
+	steamID64 *= 0xbf58476d1ce4e5b9ull;
+	steamID64 ^= steamID64 >> 27;
+	steamID64 *= 0x94d049bb133111ebull;
+	steamID64 ^= steamID64 >> 31;
+
+	return steamID64;
+}
+
+// Returns the slot holding steamID64, or the empty slot where it would go
+std::atomic<ClientAddonInfo_t *> *CClientAddonTable::Probe(SlotArray_t *pSlots, uint64 steamID64, uint64 nHash)
+{
+	if (!pSlots)
+		return nullptr;
+
+	for (size_t i = (nHash / k_nShards) & pSlots->m_nMask;; i = (i + 1) & pSlots->m_nMask)
+	{
+		std::atomic<ClientAddonInfo_t *> &slot = pSlots->m_Slots[i];
+		ClientAddonInfo_t *pInfo = slot.load();
+
+		if (!pInfo || pInfo->steamID64 == steamID64)
+			return &slot;
+	}
+}
+
+// Rehashes into a new array before publishing it, lookups still walking the old one are left alone until they're done with it
+void CClientAddonTable::Grow(Shard_t &shard)
+{
+	SlotArray_t *pOldSlots = shard.m_pSlots.load();
+	SlotArray_t *pNewSlots = new SlotArray_t(pOldSlots ? pOldSlots->m_Slots.size() * 2 : k_nInitialShardSize);
+
+	if (pOldSlots)
+	{
+		for (std::atomic<ClientAddonInfo_t *> &slot : pOldSlots->m_Slots)
+		{
+			if (ClientAddonInfo_t *pInfo = slot.load())
+				Probe(pNewSlots, pInfo->steamID64, Hash(pInfo->steamID64))->store(pInfo);
+		}
+	}
+
+	shard.m_pSlots.store(pNewSlots);
+
+	if (pOldSlots)
+		g_Rcu.Retire(pOldSlots);
+}
+
+ClientAddonInfo_t *CClientAddonTable::Find(uint64 steamID64)
+{
+	if (!steamID64)
+		return nullptr;
+
+	uint64 nHash = Hash(steamID64);
+	Shard_t &shard = GetShard(nHash);
+
+	for (;;)
+	{
+		uint32 nVersion = shard.m_nVersion.load();
+
+		// The main thread is partway through a change, it only takes a few stores
+		if (nVersion & 1)
+			continue;
+
+		std::atomic<ClientAddonInfo_t *> *pSlot = Probe(shard.m_pSlots.load(), steamID64, nHash);
+		ClientAddonInfo_t *pInfo = pSlot ? pSlot->load() : nullptr;
+
+		// A hit is always right since the key comes from the entry. A miss is only trusted if nothing moved while probing
+		if (pInfo || shard.m_nVersion.load() == nVersion)
+			return pInfo;
+	}
+}
+
+ClientAddonInfo_t *CClientAddonTable::FindOrCreate(uint64 steamID64)
+{
+	if (!steamID64)
+		return nullptr;
+
+	uint64 nHash = Hash(steamID64);
+	Shard_t &shard = GetShard(nHash);
+	std::atomic<ClientAddonInfo_t *> *pSlot = Probe(shard.m_pSlots.load(), steamID64, nHash);
+
+	if (pSlot && pSlot->load())
+		return pSlot->load();
+
+	ClientAddonInfo_t *pInfo = new ClientAddonInfo_t;
+	pInfo->steamID64 = steamID64;
+
+	shard.m_nVersion++;
+
+	// Keep the load factor under 1/2 so probe sequences stay short
+	if (!pSlot || (shard.m_nCount + 1) * 2 > shard.m_pSlots.load()->m_Slots.size())
+	{
+		Grow(shard);
+		pSlot = Probe(shard.m_pSlots.load(), steamID64, nHash);
+	}
+
+	pSlot->store(pInfo);
+	shard.m_nCount++;
+
+	shard.m_nVersion++;
+
+	m_nEntries++;
+	LruLinkHead(pInfo);
+	pInfo->accountedBytes = EstimateSize(pInfo);
+	m_nBytes += pInfo->accountedBytes;
+
+	return pInfo;
+}
+
+void CClientAddonTable::Remove(uint64 steamID64)
+{
+	if (!steamID64)
+		return;
+
+	uint64 nHash = Hash(steamID64);
+	Shard_t &shard = GetShard(nHash);
+	SlotArray_t *pSlots = shard.m_pSlots.load();
+	std::atomic<ClientAddonInfo_t *> *pSlot = Probe(pSlots, steamID64, nHash);
+
+	if (!pSlot || !pSlot->load())
+		return;
+
+	ClientAddonInfo_t *pInfo = pSlot->load();
+
+	shard.m_nVersion++;
+
+	// Backward shift deletion, pull following entries of the probe sequence into the hole so no tombstones are needed.
+	// An entry briefly sits in two slots while it's moved, which lookups don't mind, the hole is only emptied at the end
+	size_t nMask = pSlots->m_nMask;
+	size_t iHole = pSlot - pSlots->m_Slots.data();
+
+	for (size_t i = (iHole + 1) & nMask;; i = (i + 1) & nMask)
+	{
+		ClientAddonInfo_t *pMoved = pSlots->m_Slots[i].load();
+
+		if (!pMoved)
+			break;
+
+		// An entry can only fill the hole if the hole lies between its home slot and where it currently is
+		size_t iHome = (Hash(pMoved->steamID64) / k_nShards) & nMask;
+		if (((i - iHome) & nMask) >= ((i - iHole) & nMask))
+		{
+			pSlots->m_Slots[iHole].store(pMoved);
+			iHole = i;
+		}
+	}
+
+	pSlots->m_Slots[iHole].store(nullptr);
+	shard.m_nCount--;
+
+	shard.m_nVersion++;
+
+	LruUnlink(pInfo);
+	m_nEntries--;
+	m_nBytes -= pInfo->accountedBytes;
+
+	// Network threads might still be reading it
+	g_Rcu.Retire(pInfo);
+}
+
+void CClientAddonTable::Touch(ClientAddonInfo_t *pInfo)
+{
+	if (m_pLruHead != pInfo)
+	{
+		LruUnlink(pInfo);
+		LruLinkHead(pInfo);
+	}
+
+	m_nBytes -= pInfo->accountedBytes;
+	pInfo->accountedBytes = EstimateSize(pInfo);
+	m_nBytes += pInfo->accountedBytes;
+}
+
+size_t CClientAddonTable::EstimateSize(const ClientAddonInfo_t *pInfo)
+{
+	const ClientAddonSnapshot_t *pSnapshot = pInfo->snapshot.Get();
+	size_t nSnapshotSize = pSnapshot ? sizeof(ClientAddonSnapshot_t) + pSnapshot->addonsToLoad.GetMemoryUsage() + pSnapshot->downloadedAddons.GetMemoryUsage() : 0;
+
+	return sizeof(ClientAddonInfo_t) + sizeof(ClientAddonInfo_t *) * 2 + nSnapshotSize
+		+ pInfo->addonsToLoad.GetMemoryUsage()
+		+ pInfo->addonList.GetMemoryUsage()
+		+ pInfo->addonListString.capacity()
+		+ pInfo->downloadedAddons.GetMemoryUsage()
+		+ pInfo->downloadedStamps.capacity() * sizeof(AddonInstallStamp_t);
+}
+
+void CClientAddonTable::ClearDownloadState(ClientAddonInfo_t *pInfo)
+{
+	pInfo->currentPendingAddon = 0;
+	pInfo->ClearDownloads();
+	pInfo->PublishSnapshot();
+}
+
+void CClientAddonTable::LruUnlink(ClientAddonInfo_t *pInfo)
+{
+	if (pInfo->lruPrev)
+		pInfo->lruPrev->lruNext = pInfo->lruNext;
+	else if (m_pLruHead == pInfo)
+		m_pLruHead = pInfo->lruNext;
+
+	if (pInfo->lruNext)
+		pInfo->lruNext->lruPrev = pInfo->lruPrev;
+	else if (m_pLruTail == pInfo)
+		m_pLruTail = pInfo->lruPrev;
+
+	pInfo->lruPrev = nullptr;
+	pInfo->lruNext = nullptr;
+}
+
+void CClientAddonTable::LruLinkHead(ClientAddonInfo_t *pInfo)
+{
+	pInfo->lruPrev = nullptr;
+	pInfo->lruNext = m_pLruHead;
+
+	if (m_pLruHead)
+		m_pLruHead->lruPrev = pInfo;
+	else
+		m_pLruTail = pInfo;
+
+	m_pLruHead = pInfo;
+}
@@ -0,0 +1,219 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "addonregistry.h"
+#include "utils/rcu.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+enum ClientConnectedState_t
+{
+	CLIENTCONN_NONE,
+	CLIENTCONN_CONNECTING,
+	CLIENTCONN_JOINED
+};
+
+// Installed version of an addon as reported by ISteamUGC::GetItemInstallInfo, all zero if unknown or not a workshop addon
+struct AddonInstallStamp_t
+{
+	uint32 m_nTimeUpdated;
+	uint64 m_nSizeOnDisk;
+
+	bool operator==(const AddonInstallStamp_t &other) const { return m_nTimeUpdated == other.m_nTimeUpdated && m_nSizeOnDisk == other.m_nSizeOnDisk; }
+	bool operator!=(const AddonInstallStamp_t &other) const { return !(*this == other); }
+};
+
+// The part of a client's addon state SendNetMessage needs, immutable once published
+struct ClientAddonSnapshot_t
+{
+	CAddonList addonsToLoad;
+	CAddonBitSet downloadedAddons;
+};
+
+struct ClientAddonInfo_t
+{
+	// These two are written from SendNetMessage, which can run on a network thread
+	std::atomic<double> lastActiveTime {};
+	std::atomic<PublishedFileId_t> currentPendingAddon {};
+
+	// What network threads read instead of the lists below, so they never lock or allocate
+	CRcuPointer<ClientAddonSnapshot_t> snapshot;
+
+	// Main thread only, PublishSnapshot must be called after modifying addonsToLoad or downloadedAddons
+	CAddonList addonsToLoad;
+	// Cached full addon list for this client, only valid if addonListGeneration matches the global generation
+	CAddonList addonList;
+	std::string addonListString;
+	uint32 addonListGeneration {};
+	CAddonBitSet downloadedAddons;
+	// The version of each downloaded addon the client got, indexed by registry slot. Main thread only
+	std::vector<AddonInstallStamp_t> downloadedStamps;
+
+	void PublishSnapshot() { snapshot.Publish(new ClientAddonSnapshot_t { addonsToLoad, downloadedAddons }); }
+
+	void MarkDownloaded(PublishedFileId_t addon, const AddonInstallStamp_t &stamp)
+	{
+		int iSlot = g_AddonRegistry.GetSlot(addon);
+		if (iSlot == -1)
+			return;
+
+		downloadedAddons.Set(iSlot);
+
+		if (iSlot >= (int)downloadedStamps.size())
+			downloadedStamps.resize(iSlot + 1, AddonInstallStamp_t {});
+
+		downloadedStamps[iSlot] = stamp;
+	}
+
+	void ClearDownloads()
+	{
+		downloadedAddons.ClearAll();
+		downloadedStamps.clear();
+	}
+
+	ClientConnectedState_t connectedState = CLIENTCONN_NONE;
+	double connectionStartTime {};
+
+	// Bookkeeping for CClientAddonTable, main thread only
+	uint64 steamID64 {};
+	ClientAddonInfo_t *lruPrev = nullptr;
+	ClientAddonInfo_t *lruNext = nullptr;
+	size_t accountedBytes {};
+};
+
+// SteamID keyed table of client addon state, split in shards that each grow on their own.
+// Only the main thread modifies the table. Find doesn't lock, so network threads never wait on the main thread:
+// entries are allocated once and never move, and removed entries as well as outgrown slot arrays are retired through g_Rcu,
+// so off the main thread a pointer returned by Find stays valid until the CRcuReadScope it was obtained in ends.
+// The main thread also keeps every entry in a recency list, so the table can be held to an entry and memory budget.
+class CClientAddonTable
+{
+public:
+	~CClientAddonTable();
+
+	// Any thread, never inserts
+	ClientAddonInfo_t *Find(uint64 steamID64);
+
+	// Main thread only, returns nullptr for steamID64 0 (bots, listenserver host etc.)
+	ClientAddonInfo_t *FindOrCreate(uint64 steamID64);
+
+	// Main thread only
+	void Remove(uint64 steamID64);
+
+	// Main thread only, marks the entry as most recently used and recounts its memory usage.
+	// Should be called whenever the client is seen or its addon lists change.
+	void Touch(ClientAddonInfo_t *pInfo);
+
+	// Main thread only. Looks at up to nMaxSteps of the least recently used entries and removes them if the table is over budget
+	// or they haven't been active since flExpireTime. Entries for which isInUse returns true are never removed.
+	// Expired entries holding addons pushed by plugins only lose their download state, so per-client addons aren't silently dropped.
+	template <class F>
+	void Sweep(double flExpireTime, int nMaxEntries, size_t nMaxBytes, int nMaxSteps, F &&isInUse)
+	{
+		for (int i = 0; i < nMaxSteps && m_pLruTail; i++)
+		{
+			ClientAddonInfo_t *pInfo = m_pLruTail;
+
+			if (isInUse(pInfo->steamID64))
+			{
+				Touch(pInfo);
+				continue;
+			}
+
+			bool bOverBudget = (nMaxEntries > 0 && m_nEntries > nMaxEntries) || (nMaxBytes > 0 && m_nBytes > nMaxBytes);
+
+			if (!bOverBudget && pInfo->lastActiveTime.load() >= flExpireTime)
+				break;
+
+			if (bOverBudget || pInfo->addonsToLoad.IsEmpty())
+			{
+				Remove(pInfo->steamID64);
+			}
+			else
+			{
+				ClearDownloadState(pInfo);
+				Touch(pInfo);
+			}
+		}
+	}
+
+	int Count() const { return m_nEntries; }
+	size_t GetMemoryUsage() const { return m_nBytes; }
+
+	// Main thread only, the callback must not add or remove entries
+	template <class F>
+	void ForEach(F &&func)
+	{
+		for (Shard_t &shard : m_Shards)
+		{
+			SlotArray_t *pSlots = shard.m_pSlots.load();
+			if (!pSlots)
+				continue;
+
+			for (std::atomic<ClientAddonInfo_t *> &slot : pSlots->m_Slots)
+			{
+				if (ClientAddonInfo_t *pInfo = slot.load())
+					func(pInfo->steamID64, *pInfo);
+			}
+		}
+	}
+
+private:
+	static constexpr int k_nShards = 16;
+	static constexpr size_t k_nInitialShardSize = 16;
+
+	// Open addressed by SteamID, the key is read from the entry itself so a slot is a single atomic pointer
+	struct SlotArray_t
+	{
+		explicit SlotArray_t(size_t nSize) : m_nMask(nSize - 1), m_Slots(nSize) {}
+
+		size_t m_nMask;
+		std::vector<std::atomic<ClientAddonInfo_t *>> m_Slots;
+	};
+
+	struct Shard_t
+	{
+		std::atomic<SlotArray_t *> m_pSlots { nullptr };
+		// Odd while the main thread is changing the shard, so a lookup that misses can tell it might have raced a move and retry
+		std::atomic<uint32> m_nVersion { 0 };
+		size_t m_nCount = 0;
+	};
+
+	static uint64 Hash(uint64 steamID64);
+	static size_t EstimateSize(const ClientAddonInfo_t *pInfo);
+	static void ClearDownloadState(ClientAddonInfo_t *pInfo);
+	void LruUnlink(ClientAddonInfo_t *pInfo);
+	void LruLinkHead(ClientAddonInfo_t *pInfo);
+	Shard_t &GetShard(uint64 nHash) { return m_Shards[nHash % k_nShards]; }
+	static std::atomic<ClientAddonInfo_t *> *Probe(SlotArray_t *pSlots, uint64 steamID64, uint64 nHash);
+	static void Grow(Shard_t &shard);
+
+	Shard_t m_Shards[k_nShards];
+
+	// Recency list, most recently used at the head
+	ClientAddonInfo_t *m_pLruHead = nullptr;
+	ClientAddonInfo_t *m_pLruTail = nullptr;
+	int m_nEntries = 0;
+	size_t m_nBytes = 0;
+};
+
+extern CClientAddonTable g_ClientAddons;
@@ -0,0 +1,343 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clientdownloadcache.h"
+#include "threadtools.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "tier0/memdbgon.h"
+
+CClientDownloadCache g_ClientDownloadCache;
+
+bool CClientDownloadCache::Open(const char *pszPath, uint32 nCapacity, bool bShared)
+{
+	Close();
+
+	// Round up to a power of two so probing can mask instead of divide
+	uint32 nRounded = k_nMaxProbe;
+	while (nRounded < nCapacity)
+		nRounded <<= 1;
+
+	if (!Plat_MapFile(pszPath, sizeof(Header_t), m_File))
+		return false;
+
+	m_sPath = pszPath;
+	m_nCapacity = nRounded;
+	m_bShared = bShared;
+
+	// Other instances sharing the file can be opening or laying it out at the same time, take turns
+	if (!Plat_LockMappedFile(m_File))
+	{
+		Close();
+		return false;
+	}
+
+	bool bAttached = Attach(bShared);
+	Plat_UnlockMappedFile(m_File);
+
+	if (!bAttached)
+		Close();
+
+	return bAttached;
+}
+
+// Adopts the layout in the file, or lays it out again if it's unusable. Called with the file locked
+bool CClientDownloadCache::Attach(bool bAdoptCapacity)
+{
+	Header_t *pHeader = GetHeader();
+	uint32 nFileCapacity = pHeader->m_nCapacity;
+	bool bValid = pHeader->m_nMagic.load(std::memory_order_acquire) == k_nMagic && pHeader->m_nVersion == k_nVersion && nFileCapacity >= k_nMaxProbe && !(nFileCapacity & (nFileCapacity - 1));
+
+	if (bValid && (nFileCapacity == m_nCapacity || bAdoptCapacity))
+	{
+		// Our mapping might predate the file being grown by whoever laid it out
+		if (!Plat_GrowMappedFile(m_File, GetFileSize(nFileCapacity)))
+			return false;
+
+		m_nMask = nFileCapacity - 1;
+		m_nGeneration = GetHeader()->m_nGeneration.load(std::memory_order_acquire);
+		MarkDirty(nullptr);
+
+		return true;
+	}
+
+	return Rebuild(bValid ? nFileCapacity : 0);
+}
+
+// Lays the file out again in place with our capacity, keeping what records fit. Called with the file locked.
+// The file isn't replaced, instances still mapping it see the generation change and attach to the new layout
+bool CClientDownloadCache::Rebuild(uint32 nOldCapacity)
+{
+	std::vector<RecordData_t> oldRecords;
+
+	if (nOldCapacity && m_File.nSize >= GetFileSize(nOldCapacity))
+	{
+		Record_t *pRecords = GetRecords();
+
+		for (uint32 i = 0; i < nOldCapacity; i++)
+		{
+			RecordData_t data = Read(&pRecords[i]);
+			if (data.m_nSteamID)
+				oldRecords.push_back(data);
+		}
+	}
+
+	// From here on readers in other instances no longer trust what they read, until they attach again
+	Header_t *pHeader = GetHeader();
+	uint32 nGeneration = pHeader->m_nGeneration.load(std::memory_order_relaxed) + 1;
+
+	pHeader->m_nMagic.store(k_nInitMagic, std::memory_order_relaxed);
+	pHeader->m_nGeneration.store(nGeneration, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (!Plat_GrowMappedFile(m_File, GetFileSize(m_nCapacity)))
+		return false;
+
+	pHeader = GetHeader();
+	memset((void *)GetRecords(), 0, (size_t)m_nCapacity * sizeof(Record_t));
+
+	m_nMask = m_nCapacity - 1;
+	m_nGeneration = nGeneration;
+
+	for (const RecordData_t &record : oldRecords)
+		Store(record);
+
+	// The magic is published last so nobody uses the layout before it's complete
+	pHeader->m_nVersion = k_nVersion;
+	pHeader->m_nCapacity = m_nCapacity;
+	pHeader->m_nMagic.store(k_nMagic, std::memory_order_release);
+
+	MarkDirty(nullptr);
+	Flush();
+
+	return true;
+}
+
+// Whether the layout we use is still the one in the file, another instance could have laid it out again
+bool CClientDownloadCache::IsCurrent()
+{
+	Header_t *pHeader = GetHeader();
+	return pHeader->m_nMagic.load(std::memory_order_acquire) == k_nMagic && pHeader->m_nGeneration.load(std::memory_order_relaxed) == m_nGeneration;
+}
+
+// Returns false if the file is being laid out again, it's fine to skip the cache until that's done
+bool CClientDownloadCache::Refresh()
+{
+	if (IsCurrent())
+		return true;
+
+	// Whoever is laying it out holds the lock, so this waits for them to finish
+	if (!Plat_LockMappedFile(m_File))
+		return false;
+
+	bool bAttached = Attach(true);
+	Plat_UnlockMappedFile(m_File);
+
+	return bAttached && IsCurrent();
+}
+
+void CClientDownloadCache::Close()
+{
+	Flush();
+	Plat_UnmapFile(m_File);
+	m_nMask = 0;
+	m_nGeneration = 0;
+	m_bShared = false;
+}
+
+uint64 CClientDownloadCache::Hash(uint64 steamID64, PublishedFileId_t addon)
+{
+	uint64 nHash = steamID64 ^ (addon * 0x9e3779b97f4a7c15ull);
+
+	nHash ^= nHash >> 30;
+	nHash *= 0xbf58476d1ce4e5b9ull;
+	nHash ^= nHash >> 27;
+	nHash *= 0x94d049bb133111ebull;
+	nHash ^= nHash >> 31;
+
+	return nHash;
+}
+
+CClientDownloadCache::RecordData_t CClientDownloadCache::Read(Record_t *pRecord)
+{
+	RecordData_t data;
+	uint32 nStuckSequence = 0;
+
+	for (int i = 0;; i++)
+	{
+		uint32 nSequence = pRecord->m_nSequence.load(std::memory_order_acquire);
+
+		if (nSequence & 1)
+		{
+			// Only count the time while it's the same write
+			if (nSequence != nStuckSequence)
+			{
+				nStuckSequence = nSequence;
+				i = 0;
+			}
+
+			if (i < k_nMaxReadSpins)
+			{
+				ThreadPause();
+				continue;
+			}
+
+			if (i < k_nMaxReadSpins + k_nStuckWriteMs)
+			{
+				ThreadSleep(1);
+				continue;
+			}
+
+			// The writer most likely died halfway, take the record over and empty it so it doesn't stay unusable forever.
+			// If the writer was only slow, its write fails to complete and is dropped
+			if (pRecord->m_nSequence.compare_exchange_strong(nSequence, nSequence + 2, std::memory_order_acquire))
+			{
+				std::atomic_thread_fence(std::memory_order_release);
+
+				pRecord->m_nSteamID.store(0, std::memory_order_relaxed);
+				pRecord->m_nAddon.store(0, std::memory_order_relaxed);
+				pRecord->m_nTimeUpdated.store(0, std::memory_order_relaxed);
+				pRecord->m_nLastSeen.store(0, std::memory_order_relaxed);
+
+				pRecord->m_nSequence.store(nSequence + 3, std::memory_order_release);
+
+				return {};
+			}
+
+			continue;
+		}
+
+		data.m_nSteamID = pRecord->m_nSteamID.load(std::memory_order_relaxed);
+		data.m_nAddon = pRecord->m_nAddon.load(std::memory_order_relaxed);
+		data.m_nTimeUpdated = pRecord->m_nTimeUpdated.load(std::memory_order_relaxed);
+		data.m_nLastSeen = pRecord->m_nLastSeen.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (pRecord->m_nSequence.load(std::memory_order_relaxed) == nSequence)
+			return data;
+	}
+}
+
+// Returns false if another process is writing the record
+bool CClientDownloadCache::Write(Record_t *pRecord, const RecordData_t &data)
+{
+	uint32 nSequence = pRecord->m_nSequence.load(std::memory_order_relaxed);
+
+	if ((nSequence & 1) || !pRecord->m_nSequence.compare_exchange_strong(nSequence, nSequence + 1, std::memory_order_acquire))
+		return false;
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	pRecord->m_nSteamID.store(data.m_nSteamID, std::memory_order_relaxed);
+	pRecord->m_nAddon.store(data.m_nAddon, std::memory_order_relaxed);
+	pRecord->m_nTimeUpdated.store(data.m_nTimeUpdated, std::memory_order_relaxed);
+	pRecord->m_nLastSeen.store(data.m_nLastSeen, std::memory_order_relaxed);
+
+	// Fails if a reader took the record over thinking we died
+	uint32 nClaimed = nSequence + 1;
+	return pRecord->m_nSequence.compare_exchange_strong(nClaimed, nSequence + 2, std::memory_order_release, std::memory_order_relaxed);
+}
+
+// Returns the record holding the key, or the one it should be written to, along with a copy of its current contents
+CClientDownloadCache::Record_t *CClientDownloadCache::Lookup(uint64 steamID64, PublishedFileId_t addon, RecordData_t &data)
+{
+	Record_t *pRecords = GetRecords();
+	Record_t *pOldest = nullptr;
+	RecordData_t oldestData {};
+	uint32 nStart = (uint32)Hash(steamID64, addon) & m_nMask;
+
+	for (uint32 i = 0; i < k_nMaxProbe; i++)
+	{
+		Record_t *pRecord = &pRecords[(nStart + i) & m_nMask];
+		data = Read(pRecord);
+
+		if (!data.m_nSteamID || (data.m_nSteamID == steamID64 && data.m_nAddon == addon))
+			return pRecord;
+
+		if (!pOldest || data.m_nLastSeen < oldestData.m_nLastSeen)
+		{
+			pOldest = pRecord;
+			oldestData = data;
+		}
+	}
+
+	data = oldestData;
+	return pOldest;
+}
+
+bool CClientDownloadCache::Has(uint64 steamID64, PublishedFileId_t addon, uint32 nTimeUpdated, uint32 nMinLastSeen)
+{
+	if (!IsOpen() || !steamID64 || !Refresh())
+		return false;
+
+	RecordData_t data;
+	Lookup(steamID64, addon, data);
+
+	// What we read is garbage if the file was laid out again meanwhile
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!IsCurrent())
+		return false;
+
+	return data.m_nSteamID == steamID64 && data.m_nAddon == addon && data.m_nTimeUpdated == nTimeUpdated && data.m_nLastSeen >= nMinLastSeen;
+}
+
+void CClientDownloadCache::Set(uint64 steamID64, PublishedFileId_t addon, uint32 nTimeUpdated, uint32 nLastSeen)
+{
+	if (!IsOpen() || !steamID64 || !Refresh())
+		return;
+
+	Store({ steamID64, addon, nTimeUpdated, nLastSeen });
+}
+
+void CClientDownloadCache::Store(const RecordData_t &record)
+{
+	RecordData_t data;
+	Record_t *pRecord = Lookup(record.m_nSteamID, record.m_nAddon, data);
+
+	// Replacing a record seen more recently than this one would throw away the more useful of the two
+	if (data.m_nSteamID && (data.m_nSteamID != record.m_nSteamID || data.m_nAddon != record.m_nAddon) && data.m_nLastSeen > record.m_nLastSeen)
+		return;
+
+	if (Write(pRecord, record))
+		MarkDirty(pRecord);
+}
+
+// nullptr marks the whole file
+void CClientDownloadCache::MarkDirty(const Record_t *pRecord)
+{
+	size_t nStart = pRecord ? (const uint8 *)pRecord - m_File.pData : 0;
+	size_t nEnd = pRecord ? nStart + sizeof(Record_t) : m_File.nSize;
+
+	m_nDirtyStart = MIN(m_nDirtyStart, nStart);
+	m_nDirtyEnd = MAX(m_nDirtyEnd, nEnd);
+}
+
+void CClientDownloadCache::Flush()
+{
+	if (!IsOpen() || m_nDirtyStart >= m_nDirtyEnd)
+		return;
+
+	Plat_FlushMappedFile(m_File, m_nDirtyStart, m_nDirtyEnd - m_nDirtyStart);
+
+	m_nDirtyStart = SIZE_MAX;
+	m_nDirtyEnd = 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "utils/plat.h"
+#include "steam/steamclientpublic.h"
+#include <atomic>
+#include <string>
+
+// On-disk record of which addons clients have downloaded, so the cache survives server restarts.
+// The file is a fixed size open addressing table keyed by SteamID and addon which is memory mapped as is, so loading
+// it costs nothing and every update is a write into the mapping. Dirty records are written back in the background by Flush.
+// When the probe window of a key is full, the least recently seen record in it is replaced, so the file never grows.
+// The file can be shared by several server instances on the same machine. Each record is guarded by a sequence counter:
+// reads never block and retry if a write raced with them, writes claim the record with a compare and swap and give up if
+// another process holds it, which is fine for a cache. A record left mid-write by a process that died is emptied by the
+// next reader that waits on it for too long.
+// Laying the file out again happens in place under the file lock and bumps the generation in the header, instances
+// check it around every access and attach to the new layout when it changed.
+// Within a process, main thread only.
+class CClientDownloadCache
+{
+public:
+	~CClientDownloadCache() { Close(); }
+
+	// Maps the file, creating or rebuilding it if it doesn't exist or is from another version.
+	// A file with another capacity is rebuilt unless it's shared, in which case its capacity is adopted so instances agree on the layout.
+	bool Open(const char *pszPath, uint32 nCapacity, bool bShared);
+	void Close();
+	bool IsOpen() const { return m_File.pData != nullptr; }
+	bool IsShared() const { return m_bShared; }
+	const std::string &GetPath() const { return m_sPath; }
+
+	// Whether the client downloaded this version of the addon, and was last seen with it at or after nMinLastSeen
+	bool Has(uint64 steamID64, PublishedFileId_t addon, uint32 nTimeUpdated, uint32 nMinLastSeen);
+	void Set(uint64 steamID64, PublishedFileId_t addon, uint32 nTimeUpdated, uint32 nLastSeen);
+
+	// Write back everything modified since the last flush
+	void Flush();
+
+private:
+	static constexpr uint32 k_nMagic = 0x434D414D; // "MAMC"
+	static constexpr uint32 k_nInitMagic = 0x494D414D; // "MAMI", while the file is being laid out
+	static constexpr uint32 k_nVersion = 3;
+	static constexpr uint32 k_nMaxProbe = 16;
+	static constexpr int k_nMaxReadSpins = 1000;
+	static constexpr int k_nStuckWriteMs = 20; // How long a write can stay in progress after the spinning before its writer is presumed dead
+
+	struct Header_t
+	{
+		std::atomic<uint32> m_nMagic; // Written last when creating the file
+		uint32 m_nVersion;
+		uint32 m_nCapacity; // Power of two
+		std::atomic<uint32> m_nGeneration; // Bumped whenever the file is laid out again
+	};
+
+	// Only lock-free atomics, so they work across processes mapping the same file
+	struct Record_t
+	{
+		std::atomic<uint32> m_nSequence; // Odd while a write is in progress
+		std::atomic<uint32> m_nTimeUpdated; // Workshop update time of the addon version the client has
+		std::atomic<uint64> m_nSteamID; // 0 means empty
+		std::atomic<PublishedFileId_t> m_nAddon;
+		std::atomic<uint32> m_nLastSeen; // Unix time
+		uint32 m_nReserved;
+	};
+
+	// Consistent copy of a record
+	struct RecordData_t
+	{
+		uint64 m_nSteamID;
+		PublishedFileId_t m_nAddon;
+		uint32 m_nTimeUpdated;
+		uint32 m_nLastSeen;
+	};
+
+	static RecordData_t Read(Record_t *pRecord);
+	static bool Write(Record_t *pRecord, const RecordData_t &data);
+
+	static size_t GetFileSize(uint32 nCapacity) { return sizeof(Header_t) + (size_t)nCapacity * sizeof(Record_t); }
+	static uint64 Hash(uint64 steamID64, PublishedFileId_t addon);
+
+	Header_t *GetHeader() { return (Header_t *)m_File.pData; }
+	Record_t *GetRecords() { return (Record_t *)(m_File.pData + sizeof(Header_t)); }
+	Record_t *Lookup(uint64 steamID64, PublishedFileId_t addon, RecordData_t &data);
+	void Store(const RecordData_t &record);
+	bool Attach(bool bAdoptCapacity);
+	bool Rebuild(uint32 nOldCapacity);
+	bool IsCurrent();
+	bool Refresh();
+	void MarkDirty(const Record_t *pRecord);
+
+	MappedFile m_File;
+	std::string m_sPath;
+	uint32 m_nCapacity = 0; // What we asked for, the file can have another one if it's shared
+	uint32 m_nMask = 0;
+	uint32 m_nGeneration = 0;
+	bool m_bShared = false;
+
+	// Range of records modified since the last flush
+	size_t m_nDirtyStart = SIZE_MAX;
+	size_t m_nDirtyEnd = 0;
+};
+
+extern CClientDownloadCache g_ClientDownloadCache;
@@ -0,0 +1,156 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clientindex.h"
+#include "serversideclient.h"
+
+#include "tier0/memdbgon.h"
+
+CClientIndex g_ClientIndex;
+
+void CClientIndex::Set(CPlayerSlot slot, uint64 steamID64, CServerSideClient *pClient)
+{
+	if (!IsValidSlot(slot))
+		return;
+
+	// ClientConnect doesn't give us the client, look it up once here instead of on every use
+	if (!pClient)
+	{
+		Slot_t &current = m_Slots[slot.Get()];
+
+		if (current.m_pClient && current.m_nSteamID == steamID64)
+			return;
+
+		CUtlVector<CServerSideClient *> *pClients = GetClientList();
+		if (!pClients)
+			return;
+
+		FOR_EACH_VEC(*pClients, i)
+		{
+			CServerSideClient *pListClient = (*pClients)[i];
+			if (pListClient && pListClient->GetPlayerSlot().Get() == slot.Get())
+			{
+				pClient = pListClient;
+				break;
+			}
+		}
+
+		if (!pClient)
+			return;
+	}
+
+	Clear(slot);
+
+	Slot_t &entry = m_Slots[slot.Get()];
+	entry.m_nSteamID = steamID64;
+	entry.m_pClient = pClient;
+
+	if (steamID64)
+	{
+		// The same SteamID can't be in two slots, drop the old one if they reconnected before their disconnect was processed
+		auto it = m_SlotBySteamID.find(steamID64);
+		if (it != m_SlotBySteamID.end() && it->second != slot.Get())
+		{
+			m_Slots[it->second].m_nSteamID = 0;
+			m_Slots[it->second].m_pClient = nullptr;
+		}
+
+		m_SlotBySteamID[steamID64] = slot.Get();
+	}
+}
+
+void CClientIndex::Clear(CPlayerSlot slot)
+{
+	if (!IsValidSlot(slot))
+		return;
+
+	Slot_t &entry = m_Slots[slot.Get()];
+
+	if (entry.m_nSteamID)
+	{
+		auto it = m_SlotBySteamID.find(entry.m_nSteamID);
+		if (it != m_SlotBySteamID.end() && it->second == slot.Get())
+			m_SlotBySteamID.erase(it);
+	}
+
+	entry.m_nSteamID = 0;
+	entry.m_pClient = nullptr;
+	entry.m_flLastActiveTime.store(0.0, std::memory_order_relaxed);
+}
+
+void CClientIndex::ClearAll()
+{
+	for (int i = 0; i < k_nMaxSlots; i++)
+		Clear(CPlayerSlot(i));
+}
+
+void CClientIndex::Rebuild()
+{
+	ClearAll();
+
+	CUtlVector<CServerSideClient *> *pClients = GetClientList();
+	if (!pClients)
+		return;
+
+	FOR_EACH_VEC(*pClients, i)
+	{
+		CServerSideClient *pClient = (*pClients)[i];
+		if (pClient)
+			Set(pClient->GetPlayerSlot(), pClient->GetClientSteamID().ConvertToUint64(), pClient);
+	}
+}
+
+CServerSideClient *CClientIndex::FindClient(uint64 steamID64)
+{
+	if (!steamID64)
+		return nullptr;
+
+	auto it = m_SlotBySteamID.find(steamID64);
+	if (it == m_SlotBySteamID.end())
+		return nullptr;
+
+	return GetValidatedClient(it->second);
+}
+
+// Clients can go away without a ClientDisconnect (e.g. dropped while still downloading), so never trust a stored pointer blindly.
+// The client list is normally indexed by slot which makes this a single compare, and the pointer is only dereferenced once it's known to be live.
+CServerSideClient *CClientIndex::GetValidatedClient(int iSlot)
+{
+	Slot_t &entry = m_Slots[iSlot];
+
+	if (!entry.m_pClient)
+		return nullptr;
+
+	CUtlVector<CServerSideClient *> *pClients = GetClientList();
+	if (!pClients)
+		return nullptr;
+
+	bool bLive = pClients->IsValidIndex(iSlot) && (*pClients)[iSlot] == entry.m_pClient;
+
+	if (!bLive)
+		bLive = pClients->Find(entry.m_pClient) != -1;
+
+	if (!bLive || entry.m_pClient->GetClientSteamID().ConvertToUint64() != entry.m_nSteamID)
+	{
+		Clear(CPlayerSlot(iSlot));
+		return nullptr;
+	}
+
+	return entry.m_pClient;
+}
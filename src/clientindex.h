@@ -0,0 +1,88 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "playerslot.h"
+#include "utlvector.h"
+#include <atomic>
+#include <unordered_map>
+
+class CServerSideClient;
+
+// Defined in multiaddonmanager.cpp
+CUtlVector<CServerSideClient *> *GetClientList();
+
+// Maps SteamIDs, player slots and client objects to each other, so targeted operations don't need to walk the whole client list.
+// Kept up to date from ReplyConnection, ClientConnect and ClientDisconnect.
+// Everything is main thread only, except the per-slot activity time which SendNetMessage writes from any thread.
+class CClientIndex
+{
+public:
+	static constexpr int k_nMaxSlots = 64;
+
+	void Set(CPlayerSlot slot, uint64 steamID64, CServerSideClient *pClient);
+	void Clear(CPlayerSlot slot);
+	void ClearAll();
+
+	// Repopulate the index from the server's client list, for late loads
+	void Rebuild();
+
+	// Returns nullptr if the client isn't connected
+	CServerSideClient *FindClient(uint64 steamID64);
+
+	template <class F>
+	void ForEach(F &&func)
+	{
+		for (int i = 0; i < k_nMaxSlots; i++)
+		{
+			if (CServerSideClient *pClient = GetValidatedClient(i))
+				func(m_Slots[i].m_nSteamID, pClient);
+		}
+	}
+
+	// Any thread, the last time a message was sent to this slot
+	void SetLastActiveTime(CPlayerSlot slot, double flTime)
+	{
+		if (IsValidSlot(slot))
+			m_Slots[slot.Get()].m_flLastActiveTime.store(flTime, std::memory_order_relaxed);
+	}
+
+	double GetLastActiveTime(CPlayerSlot slot) const
+	{
+		return IsValidSlot(slot) ? m_Slots[slot.Get()].m_flLastActiveTime.load(std::memory_order_relaxed) : 0.0;
+	}
+
+private:
+	static bool IsValidSlot(CPlayerSlot slot) { return slot.Get() >= 0 && slot.Get() < k_nMaxSlots; }
+
+	CServerSideClient *GetValidatedClient(int iSlot);
+
+	struct Slot_t
+	{
+		uint64 m_nSteamID = 0;
+		CServerSideClient *m_pClient = nullptr;
+		std::atomic<double> m_flLastActiveTime {};
+	};
+
+	Slot_t m_Slots[k_nMaxSlots];
+	std::unordered_map<uint64, int> m_SlotBySteamID;
+};
+
+extern CClientIndex g_ClientIndex;
@@ -0,0 +1,168 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "downloadscheduler.h"
+#include "workshopbackend.h"
+#include <algorithm>
+
+#include "tier0/memdbgon.h"
+
+DownloadItem_t *CDownloadScheduler::Find(PublishedFileId_t addon)
+{
+	auto it = m_Items.find(addon);
+
+	return it != m_Items.end() ? &it->second : nullptr;
+}
+
+bool CDownloadScheduler::Queue(PublishedFileId_t addon, bool bImportant, double flTime)
+{
+	if (DownloadItem_t *pItem = Find(addon))
+	{
+		if (bImportant && !pItem->m_bImportant)
+		{
+			pItem->m_bImportant = true;
+			m_nImportant++;
+		}
+
+		return false;
+	}
+
+	m_Items[addon] = { addon, EDownloadState::Queued, bImportant, m_nNextOrder++, flTime, 0.0, 0.0, 0, 0, 0.0, 0 };
+
+	if (bImportant)
+		m_nImportant++;
+
+	return true;
+}
+
+DownloadItem_t *CDownloadScheduler::GetNextToStart(int nMaxInFlight, double flTime)
+{
+	if (nMaxInFlight > 0 && m_nInFlight >= nMaxInFlight)
+		return nullptr;
+
+	DownloadItem_t *pNext = nullptr;
+
+	for (auto &pair : m_Items)
+	{
+		DownloadItem_t &item = pair.second;
+
+		if (item.m_eState != EDownloadState::Queued || item.m_flRetryTime > flTime)
+			continue;
+
+		if (!pNext || item.m_bImportant > pNext->m_bImportant || (item.m_bImportant == pNext->m_bImportant && item.m_nOrder < pNext->m_nOrder))
+			pNext = &item;
+	}
+
+	return pNext;
+}
+
+void CDownloadScheduler::SetInFlight(PublishedFileId_t addon, double flTime)
+{
+	DownloadItem_t *pItem = Find(addon);
+
+	if (!pItem || pItem->m_eState == EDownloadState::InFlight)
+		return;
+
+	pItem->m_eState = EDownloadState::InFlight;
+	pItem->m_flStartTime = flTime;
+	pItem->m_nLastBytes = 0;
+	pItem->m_flLastProgressTime = flTime;
+	m_nInFlight++;
+}
+
+void CDownloadScheduler::Requeue(PublishedFileId_t addon, double flRetryTime)
+{
+	DownloadItem_t *pItem = Find(addon);
+
+	if (!pItem)
+		return;
+
+	if (pItem->m_eState == EDownloadState::InFlight)
+		m_nInFlight--;
+
+	pItem->m_eState = EDownloadState::Queued;
+	pItem->m_flRetryTime = flRetryTime;
+}
+
+bool CDownloadScheduler::Retry(PublishedFileId_t addon, const DownloadRetryPolicy_t &policy, double flTime, double &flDelay)
+{
+	// Max delay between attempts in seconds
+	static constexpr double k_flMaxRetryDelay = 300.0;
+
+	DownloadItem_t *pItem = Find(addon);
+
+	if (!pItem || pItem->m_nAttempts > policy.m_nMaxRetries)
+		return false;
+
+	flDelay = std::min(policy.m_flRetryDelay * (double)(1ull << std::min(pItem->m_nAttempts - 1, 16)), k_flMaxRetryDelay);
+	flDelay *= std::uniform_real_distribution<double>(0.5, 1.0)(m_Random);
+
+	Requeue(addon, flTime + flDelay);
+
+	return true;
+}
+
+void CDownloadScheduler::StartQueued(IWorkshopBackend *pBackend, int nMaxInFlight, const DownloadRetryPolicy_t &policy, double flTime, std::vector<DownloadEvent_t> &events)
+{
+	while (DownloadItem_t *pItem = GetNextToStart(nMaxInFlight, flTime))
+	{
+		PublishedFileId_t addon = pItem->m_nAddon;
+		pItem->m_nAttempts++;
+
+		if (pBackend->DownloadItem(addon))
+		{
+			SetInFlight(addon, flTime);
+			events.push_back({ EDownloadEvent::Started, *pItem, 0.0 });
+			continue;
+		}
+
+		double flDelay = 0.0;
+
+		if (Retry(addon, policy, flTime, flDelay))
+		{
+			events.push_back({ EDownloadEvent::Retrying, *pItem, flDelay });
+			continue;
+		}
+
+		DownloadEvent_t event { EDownloadEvent::GaveUp, {}, 0.0 };
+		Remove(addon, &event.m_Item);
+		events.push_back(event);
+	}
+}
+
+bool CDownloadScheduler::Remove(PublishedFileId_t addon, DownloadItem_t *pItem)
+{
+	auto it = m_Items.find(addon);
+
+	if (it == m_Items.end())
+		return false;
+
+	if (it->second.m_eState == EDownloadState::InFlight)
+		m_nInFlight--;
+
+	if (it->second.m_bImportant)
+		m_nImportant--;
+
+	if (pItem)
+		*pItem = it->second;
+
+	m_Items.erase(it);
+
+	return true;
+}
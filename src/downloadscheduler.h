@@ -0,0 +1,117 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "steam/steamclientpublic.h"
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+class IWorkshopBackend;
+
+enum class EDownloadState
+{
+	Queued,
+	InFlight,
+};
+
+struct DownloadItem_t
+{
+	PublishedFileId_t m_nAddon;
+	EDownloadState m_eState;
+	bool m_bImportant; // Reloads the map once all important downloads are done
+	uint64 m_nOrder; // Queue position, lower is older
+	double m_flQueueTime;
+	double m_flStartTime; // When the current attempt started
+	double m_flRetryTime; // Queued items don't start before this
+	int m_nAttempts; // Including the current one
+	uint64 m_nLastBytes; // Downloaded bytes last time we looked, and when they last changed
+	double m_flLastProgressTime;
+	uint64 m_nTotalBytes; // 0 until Steam knows
+};
+
+struct DownloadRetryPolicy_t
+{
+	int m_nMaxRetries;
+	double m_flRetryDelay; // Before the first retry in seconds, doubled with every attempt
+};
+
+enum class EDownloadEvent
+{
+	Started,
+	Retrying, // Failed, queued again to start in m_flRetryDelay
+	GaveUp, // Failed and out of attempts, it's no longer scheduled
+};
+
+struct DownloadEvent_t
+{
+	EDownloadEvent m_eEvent;
+	DownloadItem_t m_Item;
+	double m_flRetryDelay;
+};
+
+// The workshop downloads we asked for, keyed by addon so completions can arrive in any order.
+// Queued items are started with important ones first and then oldest first, up to a limit of downloads in flight at once.
+// Main thread only
+class CDownloadScheduler
+{
+public:
+	// Returns nullptr if the addon isn't scheduled
+	DownloadItem_t *Find(PublishedFileId_t addon);
+
+	// Returns false if it's already scheduled, in which case it's still promoted to important if asked
+	bool Queue(PublishedFileId_t addon, bool bImportant, double flTime);
+
+	// The next queued item ready to start, nullptr if there's none or nMaxInFlight downloads are already going. Pass 0 for no limit
+	DownloadItem_t *GetNextToStart(int nMaxInFlight, double flTime);
+	void SetInFlight(PublishedFileId_t addon, double flTime);
+
+	// Put the item back in the queue, to start again no earlier than flRetryTime
+	void Requeue(PublishedFileId_t addon, double flRetryTime);
+
+	// Requeue with exponential backoff, spread out so everything that failed during the same outage doesn't come back at once.
+	// Returns false without touching the item if it's out of attempts, otherwise flDelay gets how long until it starts again
+	bool Retry(PublishedFileId_t addon, const DownloadRetryPolicy_t &policy, double flTime, double &flDelay);
+
+	// Starts everything GetNextToStart allows through the backend, what fails to start is retried or given up on as above.
+	// events gets what happened to every item in order, items given up on are already removed
+	void StartQueued(IWorkshopBackend *pBackend, int nMaxInFlight, const DownloadRetryPolicy_t &policy, double flTime, std::vector<DownloadEvent_t> &events);
+
+	// Returns false if the addon wasn't scheduled, otherwise pItem gets a copy of what was removed
+	bool Remove(PublishedFileId_t addon, DownloadItem_t *pItem = nullptr);
+
+	int Count() const { return (int)m_Items.size(); }
+	int CountInFlight() const { return m_nInFlight; }
+	int CountImportant() const { return m_nImportant; }
+
+	template <class F>
+	void ForEach(F &&func)
+	{
+		for (auto &pair : m_Items)
+			func(pair.second);
+	}
+
+private:
+	std::unordered_map<PublishedFileId_t, DownloadItem_t> m_Items;
+	uint64 m_nNextOrder = 0;
+	int m_nInFlight = 0;
+	int m_nImportant = 0;
+	std::mt19937 m_Random { std::random_device {}() };
+};
@@ -0,0 +1,121 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "mountmanifest.h"
+#include "workshopbackend.h"
+#include <stdio.h>
+#include <algorithm>
+
+#include "tier0/memdbgon.h"
+
+std::string MountManifestEntry_t::GetCheckPath(const std::string &sPath, bool bLegacy)
+{
+	if (bLegacy || sPath.size() < 4)
+		return sPath;
+
+	return sPath.substr(0, sPath.size() - 4) + "_dir.vpk";
+}
+
+bool CMountManifest::Read(const char *pszPath)
+{
+	m_Entries.clear();
+
+	FILE *pFile = fopen(pszPath, "r");
+
+	if (!pFile)
+		return false;
+
+	char szLine[1024];
+
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		unsigned long long nAddon, nSize;
+		long long nModifiedTime;
+		int iLegacy, iPathStart = 0;
+
+		if (sscanf(szLine, "%llu %i %llu %lld %n", &nAddon, &iLegacy, &nSize, &nModifiedTime, &iPathStart) != 4 || !iPathStart)
+			continue;
+
+		std::string sPath = szLine + iPathStart;
+
+		while (!sPath.empty() && (sPath.back() == '\n' || sPath.back() == '\r'))
+			sPath.pop_back();
+
+		m_Entries.push_back({ (PublishedFileId_t)nAddon, iLegacy != 0, (uint64_t)nSize, (int64_t)nModifiedTime, sPath });
+	}
+
+	fclose(pFile);
+
+	return true;
+}
+
+bool CMountManifest::Write(const char *pszPath) const
+{
+	FILE *pFile = fopen(pszPath, "w");
+
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "// Addons mounted last time in mount order, written automatically. ID, legacy VPK, size and modification time of the VPK, path\n");
+
+	for (const MountManifestEntry_t &entry : m_Entries)
+	{
+		fprintf(pFile, "%llu %i %llu %lld %s\n", (unsigned long long)entry.m_nAddon, entry.m_bLegacy ? 1 : 0,
+			(unsigned long long)entry.m_nSize, (long long)entry.m_nModifiedTime, entry.m_sPath.c_str());
+	}
+
+	fclose(pFile);
+
+	return true;
+}
+
+const MountManifestEntry_t *CMountManifest::Find(PublishedFileId_t addon) const
+{
+	auto it = std::find_if(m_Entries.begin(), m_Entries.end(), [addon](const MountManifestEntry_t &entry) { return entry.m_nAddon == addon; });
+
+	return it != m_Entries.end() ? &*it : nullptr;
+}
+
+int CMountManifest::CountMountable(const std::vector<PublishedFileId_t> &addons, const std::function<bool(const MountManifestEntry_t &)> &isUnchanged) const
+{
+	int nMountable = 0;
+
+	for (PublishedFileId_t addon : addons)
+	{
+		const MountManifestEntry_t *pEntry = Find(addon);
+
+		if (!pEntry || !isUnchanged(*pEntry))
+			break;
+
+		nMountable++;
+	}
+
+	return nMountable;
+}
+
+EManifestAddonState CMountManifest::Check(IWorkshopBackend *pBackend, PublishedFileId_t addon)
+{
+	uint32 nItemState = pBackend->GetItemState(addon);
+
+	if (!(nItemState & k_EItemStateInstalled) || (nItemState & k_EItemStateLegacyItem))
+		return EManifestAddonState::Stale;
+
+	return (nItemState & k_EItemStateNeedsUpdate) ? EManifestAddonState::NeedsUpdate : EManifestAddonState::Current;
+}
@@ -0,0 +1,71 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "steam/steamclientpublic.h"
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class IWorkshopBackend;
+
+struct MountManifestEntry_t
+{
+	PublishedFileId_t m_nAddon;
+	bool m_bLegacy;
+	uint64_t m_nSize; // Of the file GetCheckPath returns, along with its modification time
+	int64_t m_nModifiedTime;
+	std::string m_sPath; // What was mounted
+
+	// The file whose size and time tell whether an addon changed, for multi-chunk addons the _dir VPK indexes every chunk
+	static std::string GetCheckPath(const std::string &sPath, bool bLegacy);
+};
+
+enum class EManifestAddonState
+{
+	Current,
+	NeedsUpdate, // Can stay mounted, but Steam has a newer version to download
+	Stale, // Not installed or not usable anymore, it has to be mounted the regular way
+};
+
+// The addons mounted last time in mount order and what their files looked like then, so the next boot can mount them
+// before Steam is up. Only the file format and the decisions live here, the caller does the mounting.
+class CMountManifest
+{
+public:
+	bool Read(const char *pszPath);
+	bool Write(const char *pszPath) const;
+
+	void Add(const MountManifestEntry_t &entry) { m_Entries.push_back(entry); }
+	const MountManifestEntry_t *Find(PublishedFileId_t addon) const;
+	const std::vector<MountManifestEntry_t> &GetEntries() const { return m_Entries; }
+
+	// How many of the addons, from the first, can be mounted from the manifest. Stops at the first one it doesn't have
+	// or isUnchanged rejects, anything after it would end up in the wrong order
+	int CountMountable(const std::vector<PublishedFileId_t> &addons, const std::function<bool(const MountManifestEntry_t &)> &isUnchanged) const;
+
+	// Once Steam is up, what it says about an addon that was mounted from the manifest
+	static EManifestAddonState Check(IWorkshopBackend *pBackend, PublishedFileId_t addon);
+
+private:
+	std::vector<MountManifestEntry_t> m_Entries;
+};
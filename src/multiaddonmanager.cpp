@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include "multiaddonmanager.h"
 #include "module.h"
+#include "offsetcache.h"
+#include "workerpool.h"
 #include "utils/plat.h"
 #include "networksystem/inetworkserializer.h"
 #include "networksystem/inetworkmessages.h"
@@ -30,19 +32,54 @@
 #include "hoststate.h"
 #include "igameeventsystem.h"
 #include "serversideclient.h"
+#include "clientaddontable.h"
+#include "clientindex.h"
+#include "clientdownloadcache.h"
+#include "workshopbackend.h"
+#include "mountmanifest.h"
 #include "funchook.h"
 #include "filesystem.h"
 #include "steam/steam_gameserver.h"
 #include <string>
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <time.h>
+#include <math.h>
 #include "iserver.h"
 
 #include "tier0/memdbgon.h"
 
-CConVar<bool> mm_addon_mount_download("mm_addon_mount_download", FCVAR_NONE, "Whether to download an addon upon mounting even if it's installed", false);
+CConVar<int> mm_addon_download_max_concurrent("mm_addon_download_max_concurrent", FCVAR_NONE, "How many addon downloads can be in progress at once, the rest wait in a queue. 0 for no limit", 4,
+	[](CConVar<int> *cvar, CSplitScreenSlot slot, const int *new_val, const int *old_val)
+	{
+		g_MultiAddonManager.StartQueuedDownloads();
+	});
+CConVar<int> mm_addon_download_retries("mm_addon_download_retries", FCVAR_NONE, "How many times to retry a failed or stalled addon download before giving up", 5);
+CConVar<float> mm_addon_download_retry_delay("mm_addon_download_retry_delay", FCVAR_NONE, "Delay before the first retry of a failed addon download in seconds, doubled with every attempt", 5.f);
+CConVar<float> mm_addon_download_stall_timeout("mm_addon_download_stall_timeout", FCVAR_NONE, "How long an addon download can go without progress before it's restarted in seconds, 0 disables", 60.f);
+CConVar<float> mm_addon_reload_delay("mm_addon_reload_delay", FCVAR_NONE, "How long to wait for more changes before reloading the map for new addons in seconds, everything in that window is merged into one reload", 3.f);
+CConVar<bool> mm_addon_mount_download("mm_addon_mount_download", FCVAR_NONE, "Whether to check the workshop for updates of the mounted addons whenever they're refreshed, and download the ones that changed", false);
 CConVar<bool> mm_block_disconnect_messages("mm_block_disconnect_messages", FCVAR_NONE, "Whether to block \"loop shutdown\" disconnect messages", false);
-CConVar<bool> mm_cache_clients_with_addons("mm_cache_clients_with_addons", FCVAR_NONE, "Whether to cache clients addon download list, this will prevent reconnects on mapchange/rejoin", false);
+CConVar<bool> mm_cache_clients_with_addons("mm_cache_clients_with_addons", FCVAR_NONE, "Whether to cache clients addon download list, this will prevent reconnects on mapchange/rejoin", false,
+	[](CConVar<bool> *cvar, CSplitScreenSlot slot, const bool *new_val, const bool *old_val)
+	{
+		g_MultiAddonManager.OpenClientDownloadCache();
+	});
 CConVar<float> mm_cache_clients_duration("mm_cache_clients_duration", FCVAR_NONE, "How long to cache clients' downloaded addons list in seconds, pass 0 for forever.", 0.0f);
+CConVar<float> mm_cache_clients_uncached_duration("mm_cache_clients_uncached_duration", FCVAR_NONE, "Without mm_cache_clients_with_addons, how long to keep the download state of clients who left in seconds, pass 0 to only drop it when the cache is over budget", 0.0f);
+CConVar<int> mm_cache_clients_max_entries("mm_cache_clients_max_entries", FCVAR_NONE, "How many clients to keep in the addon cache at most, least recently seen clients are evicted first. 0 for no limit", 10000);
+CConVar<int> mm_cache_clients_max_kb("mm_cache_clients_max_kb", FCVAR_NONE, "How much memory the client addon cache can use at most in kilobytes, least recently seen clients are evicted first. 0 for no limit", 16384);
+CConVar<int> mm_cache_clients_file_entries("mm_cache_clients_file_entries", FCVAR_NONE, "How many client addon downloads the on-disk cache can hold, the least recently seen are replaced when full", 262144,
+	[](CConVar<int> *cvar, CSplitScreenSlot slot, const int *new_val, const int *old_val)
+	{
+		g_MultiAddonManager.OpenClientDownloadCache();
+	});
+CConVar<CUtlString> mm_cache_clients_shared_file("mm_cache_clients_shared_file", FCVAR_NONE, "Path of a client download cache file shared by all server instances on this machine, leave empty to give each instance its own", CUtlString(""),
+	[](CConVar<CUtlString> *cvar, CSplitScreenSlot slot, const CUtlString *new_val, const CUtlString *old_val)
+	{
+		g_MultiAddonManager.OpenClientDownloadCache();
+	});
 CConVar<float> mm_addon_connection_timeout("mm_addon_connection_timeout", FCVAR_NONE, "How long until clients are timed out while downloading the first required addon (usually the current map), 0 disables", 30.f);
 CConVar<float> mm_extra_addons_timeout("mm_extra_addons_timeout", FCVAR_NONE, "How long until clients are timed out in between connects for extra addons in seconds, requires mm_extra_addons to be used", 10.f);
 
@@ -74,37 +111,6 @@ void Panic(const char *msg, ...)
 	va_end(args);
 }
 
-void StringToVector(const char *pszString, CUtlVector<std::string> &vector)
-{
-	std::stringstream stream(pszString);
-
-	vector.RemoveAll();
-
-	while (stream.good())
-	{
-		std::string substr;
-		getline(stream, substr, ',');
-
-		if (!substr.empty())
-			vector.AddToTail(substr);
-	}
-}
-
-std::string VectorToString(CUtlVector<std::string> &vector)
-{
-	std::string result;
-
-	FOR_EACH_VEC(vector, i)
-	{
-		result += vector[i];
-
-		if (i + 1 < vector.Count())
-			result += ',';
-	}
-
-	return result;
-}
-
 ISteamUGC *GetSteamUGC()
 {
 	if (g_pEngineServer->IsDedicatedServer())
@@ -196,24 +202,11 @@ The list of addons to download does not have to be in order, but the addon list
 While plugins using the interface can add/remove addons at any time between these steps, it should be fine since the list of addon to load is newly checked every time the client connects.
 */
 
-enum ClientConnectedState_t
-{
-	CLIENTCONN_NONE,
-	CLIENTCONN_CONNECTING,
-	CLIENTCONN_JOINED
-};
-
-struct ClientAddonInfo_t
-{
-	double lastActiveTime {};
-	CUtlVector<std::string> addonsToLoad;
-	CUtlVector<std::string> downloadedAddons;
-	std::string currentPendingAddon;
-	ClientConnectedState_t connectedState = CLIENTCONN_NONE;
-	double connectionStartTime {};
-};
+// Whether we're running on a dedicated server, cached so network thread hooks don't need a virtual call per message
+bool g_bDedicatedServer = false;
 
-std::unordered_map<uint64, ClientAddonInfo_t> g_ClientAddons;
+// Coarse clock for the hot paths, refreshed every frame
+std::atomic<double> g_flFrameTime {};
 
 CUtlVector<CServerSideClient *> *GetClientList()
 {
@@ -223,27 +216,10 @@ CUtlVector<CServerSideClient *> *GetClientList()
 	return (CUtlVector<CServerSideClient *> *)((char *)g_pNetworkServerService->GetIGameServer() + g_iClientListOffset);
 }
 
-static CServerSideClient *FindClientBySteamID(uint64 steamID64)
-{
-	CUtlVector<CServerSideClient *> *clients = GetClientList();
-	if (!clients)
-		return nullptr;
-
-	CUtlVector<CServerSideClient *> &clientList = *clients;
-	FOR_EACH_VEC(clientList, i)
-	{
-		CServerSideClient *client = clientList[i];
-		if (client && client->GetClientSteamID().ConvertToUint64() == steamID64)
-			return client;
-	}
-
-	return nullptr;
-}
-
 CConVar<CUtlString> mm_extra_addons("mm_extra_addons", FCVAR_NONE, "The workshop IDs of extra addons separated by commas, addons will be downloaded (if not present) and mounted", CUtlString(""),
 	[](CConVar<CUtlString> *cvar, CSplitScreenSlot slot, const CUtlString *new_val, const CUtlString *old_val)
 	{
-		StringToVector(new_val->Get(), g_MultiAddonManager.m_ExtraAddons);
+		g_MultiAddonManager.m_ExtraAddons.FromString(new_val->Get());
 
 		g_MultiAddonManager.RefreshAddons();
 	});
@@ -252,7 +228,8 @@ CConVar<CUtlString> mm_extra_addons("mm_extra_addons", FCVAR_NONE, "The workshop
 CConVar<CUtlString> mm_client_extra_addons("mm_client_extra_addons", FCVAR_NONE, "The workshop IDs of extra client addons that will be applied to all clients, separated by commas", CUtlString(""),
 	[](CConVar<CUtlString> *cvar, CSplitScreenSlot slot, const CUtlString *new_val, const CUtlString *old_val)
 	{
-		StringToVector(new_val->Get(), g_MultiAddonManager.m_GlobalClientAddons);
+		g_MultiAddonManager.m_GlobalClientAddons.FromString(new_val->Get());
+		g_MultiAddonManager.BumpAddonGeneration();
 	});
 
 MultiAddonManager g_MultiAddonManager;
@@ -261,6 +238,34 @@ CGlobalVars *gpGlobals = nullptr;
 IGameEventSystem *g_pGameEventSystem = nullptr;
 IGameEventManager2 *g_pGameEventManager = nullptr;
 
+// Every signature of a module is resolved at once, all missing ones are reported before failing
+static bool ResolveSignatures(CModule &module, Signature_t *pSignatures, size_t nSignatures, const CWorkerPool &pool, char *error, size_t maxlen)
+{
+	g_OffsetCache.FindSignatures(module, pSignatures, nSignatures, &pool);
+
+	bool bFound = true;
+
+	for (size_t i = 0; i < nSignatures; i++)
+	{
+		const Signature_t &sig = pSignatures[i];
+
+		if (sig.m_iError == SIG_NOT_FOUND)
+		{
+			if (bFound)
+				V_snprintf(error, maxlen, "Could not find the signature for %s\n", sig.m_pszName);
+
+			Panic("Could not find the signature for %s\n", sig.m_pszName);
+			bFound = false;
+		}
+		else if (sig.m_iError == SIG_FOUND_MULTIPLE)
+		{
+			Panic("Signature for %s occurs multiple times! Using first match but this might end up crashing!\n", sig.m_pszName);
+		}
+	}
+
+	return bFound;
+}
+
 PLUGIN_EXPOSE(MultiAddonManager, g_MultiAddonManager);
 bool MultiAddonManager::Load(PluginId id, ISmmAPI *ismm, char *error, size_t maxlen, bool late)
 {
@@ -275,76 +280,88 @@ bool MultiAddonManager::Load(PluginId id, ISmmAPI *ismm, char *error, size_t max
 	GET_V_IFACE_ANY(GetEngineFactory, g_pGameEventSystem, IGameEventSystem, GAMEEVENTSYSTEM_INTERFACE_VERSION);
 	GET_V_IFACE_ANY(GetFileSystemFactory, g_pFullFileSystem, IFileSystem, FILESYSTEM_INTERFACE_VERSION);
 
+	g_bDedicatedServer = g_pEngineServer->IsDedicatedServer();
+	g_flFrameTime = Plat_FloatTime();
+
 	// Required to get the IMetamodListener events
 	g_SMAPI->AddListener( this, this );
 
-	CModule engineModule(ROOTBIN, "engine2");
-	CModule serverModule(GAMEBIN, "server");
+	// The modules are independent so they're parsed in parallel, then each one's signature scan is split across the pool
+	// and their vtables are indexed in parallel. Tasks only fill in their own results, which are all in before any hook goes in.
+	CWorkerPool pool;
+	std::unique_ptr<CModule> pEngineModule, pServerModule;
+
+	pool.Run({
+		[&]() { pEngineModule = std::make_unique<CModule>(ROOTBIN, "engine2"); },
+		[&]() { pServerModule = std::make_unique<CModule>(GAMEBIN, "server"); },
+	});
+
+	CModule &engineModule = *pEngineModule;
+	CModule &serverModule = *pServerModule;
+
+	Signature_t engineSignatures[] = {
+		{ "HostStateRequest", g_HostStateRequest_Sig, sizeof(g_HostStateRequest_Sig) - 1, (void **)&g_pfnSetPendingHostStateRequest },
+		{ "ReplyConnection", g_ReplyConnection_Sig, sizeof(g_ReplyConnection_Sig) - 1, (void **)&g_pfnReplyConnection },
+	};
+
+	Signature_t serverSignatures[] = {
+		{ "ScriptGetAddon", g_ScriptGetAddon_Sig, sizeof(g_ScriptGetAddon_Sig) - 1, (void **)&g_pfnScriptGetAddon },
+	};
 
-	int sig_error;
+	// Offsets found by earlier loads of the same game build are reused, which makes all of this nearly free after the first boot
+	char szOffsetCache[MAX_PATH];
+	V_snprintf(szOffsetCache, sizeof(szOffsetCache), "%s/addons/multiaddonmanager/offsets.txt", g_SMAPI->GetBaseDir());
+	g_OffsetCache.Load(szOffsetCache);
 
-	g_pfnSetPendingHostStateRequest = (HostStateRequest_t)engineModule.FindSignature(g_HostStateRequest_Sig, sizeof(g_HostStateRequest_Sig) - 1, sig_error);
+	bool bResolved = ResolveSignatures(engineModule, engineSignatures, ARRAYSIZE(engineSignatures), pool, error, maxlen)
+		&& ResolveSignatures(serverModule, serverSignatures, ARRAYSIZE(serverSignatures), pool, error, maxlen);
 
-	if (!g_pfnSetPendingHostStateRequest)
+	void **pServerSideClientVTable = nullptr;
+	void **pHLTVClientVTable = nullptr;
+	IGameEventManager2 *pCGameEventManagerVTable = nullptr;
+
+	pool.Run({
+		[&]()
+		{
+			pServerSideClientVTable = (void **)g_OffsetCache.FindVirtualTable(engineModule, "CServerSideClient");
+			pHLTVClientVTable = (void **)g_OffsetCache.FindVirtualTable(engineModule, "CHLTVClient");
+		},
+		[&]() { pCGameEventManagerVTable = (IGameEventManager2 *)g_OffsetCache.FindVirtualTable(serverModule, "CGameEventManager"); },
+	});
+
+	g_OffsetCache.Save();
+
+	if (!bResolved)
+		return false;
+
+	if (!pServerSideClientVTable || !pHLTVClientVTable || !pCGameEventManagerVTable)
 	{
-		V_snprintf(error, maxlen, "Could not find the signature for HostStateRequest\n");
+		V_snprintf(error, maxlen, "Could not find a required vtable\n");
 		Panic("%s", error);
 		return false;
 	}
-	else if (sig_error == SIG_FOUND_MULTIPLE)
-	{
-		Panic("Signature for HostStateRequest occurs multiple times! Using first match but this might end up crashing!\n");
-	}
 
 	g_pSetPendingHostStateRequest = funchook_create();
 	funchook_prepare(g_pSetPendingHostStateRequest, (void**)&g_pfnSetPendingHostStateRequest, (void*)Hook_SetPendingHostStateRequest);
 	funchook_install(g_pSetPendingHostStateRequest, 0);
 
 	// We're using funchook even though it's a virtual function because it can be called on a different thread and SourceHook isn't thread-safe
-	void **pServerSideClientVTable = (void **)engineModule.FindVirtualTable("CServerSideClient");
 	g_pfnSendNetMessage_ServerSideClient = (SendNetMessage_t)pServerSideClientVTable[g_iSendNetMessageOffset];
 
 	g_pSendNetMessageHook_ServerSideClient = funchook_create();
 	funchook_prepare(g_pSendNetMessageHook_ServerSideClient, (void**)&g_pfnSendNetMessage_ServerSideClient, (void*)Hook_SendNetMessage_ServerSideClient);
 	funchook_install(g_pSendNetMessageHook_ServerSideClient, 0);
 
-	void **pHLTVClientVTable = (void **)engineModule.FindVirtualTable("CHLTVClient");
 	g_pfnSendNetMessage_HLTVClient = (SendNetMessage_t)pHLTVClientVTable[g_iSendNetMessageOffset];
 
 	g_pSendNetMessageHook_HLTVClient = funchook_create();
 	funchook_prepare(g_pSendNetMessageHook_HLTVClient, (void **)&g_pfnSendNetMessage_HLTVClient, (void *)Hook_SendNetMessage_HLTVClient);
 	funchook_install(g_pSendNetMessageHook_HLTVClient, 0);
 
-	g_pfnReplyConnection = (ReplyConnection_t)engineModule.FindSignature(g_ReplyConnection_Sig, sizeof(g_ReplyConnection_Sig) - 1, sig_error);
-
-	if (!g_pfnReplyConnection)
-	{
-		V_snprintf(error, maxlen, "Could not find the signature for ReplyConnection\n");
-		Panic("%s", error);
-		return false;
-	}
-	else if (sig_error == SIG_FOUND_MULTIPLE)
-	{
-		Panic("Signature for ReplyConnection occurs multiple times! Using first match but this might end up crashing!\n");
-	}
-
 	g_pReplyConnectionHook = funchook_create();
 	funchook_prepare(g_pReplyConnectionHook, (void**)&g_pfnReplyConnection, (void*)Hook_ReplyConnection);
 	funchook_install(g_pReplyConnectionHook, 0);
 	
-	g_pfnScriptGetAddon = (ScriptGetAddon_t)serverModule.FindSignature(g_ScriptGetAddon_Sig, sizeof(g_ScriptGetAddon_Sig) - 1, sig_error);
-
-	if (!g_pfnScriptGetAddon)
-	{
-		V_snprintf(error, maxlen, "Could not find the signature for ScriptGetAddon\n");
-		Panic("%s", error);
-		return false;
-	}
-	else if (sig_error == SIG_FOUND_MULTIPLE)
-	{
-		Panic("Signature for ScriptGetAddon occurs multiple times! Using first match but this might end up crashing!\n");
-	}
-
 	g_pScriptGetAddonHook = funchook_create();
 	funchook_prepare(g_pScriptGetAddonHook, (void**)&g_pfnScriptGetAddon, (void*)Hook_ScriptGetAddon);
 	funchook_install(g_pScriptGetAddonHook, 0);
@@ -358,11 +375,6 @@ bool MultiAddonManager::Load(PluginId id, ISmmAPI *ismm, char *error, size_t max
 	SH_ADD_HOOK(IServerGameDLL, GameFrame, g_pSource2Server, SH_MEMBER(this, &MultiAddonManager::Hook_GameFrame), true);
 	SH_ADD_HOOK(IGameEventSystem, PostEventAbstract, g_pGameEventSystem, SH_MEMBER(this, &MultiAddonManager::Hook_PostEvent), false);
 
-	auto pCGameEventManagerVTable = (IGameEventManager2*)serverModule.FindVirtualTable("CGameEventManager");
-
-	if (!pCGameEventManagerVTable)
-		return false;
-
 	g_iLoadEventsFromFileHookId = SH_ADD_DVPHOOK(IGameEventManager2, LoadEventsFromFile, pCGameEventManagerVTable, SH_MEMBER(this, &MultiAddonManager::Hook_LoadEventsFromFile), false);
 
 	if (late)
@@ -373,8 +385,15 @@ bool MultiAddonManager::Load(PluginId id, ISmmAPI *ismm, char *error, size_t max
 		{
 			m_CallbackDownloadItemResult.Register(this, &MultiAddonManager::OnAddonDownloaded);
 		}
+
+		g_ClientIndex.Rebuild();
 	}
 
+	// Make sure network thread hooks always have a configuration to read
+	GetAddonConfig();
+
+	// The client download cache is opened by the convar callbacks once the config enables it
+
 	META_CONVAR_REGISTER(FCVAR_RELEASE);
 
 	g_pEngineServer->ServerCommand("exec multiaddonmanager/multiaddonmanager");
@@ -388,6 +407,8 @@ bool MultiAddonManager::Unload(char *error, size_t maxlen)
 {
 	ClearAddons();
 
+	g_ClientDownloadCache.Close();
+
 	SH_REMOVE_HOOK(IServerGameDLL, GameServerSteamAPIActivated, g_pSource2Server, SH_MEMBER(this, &MultiAddonManager::Hook_GameServerSteamAPIActivated), false);
 	SH_REMOVE_HOOK(INetworkServerService, StartupServer, g_pNetworkServerService, SH_MEMBER(this, &MultiAddonManager::Hook_StartupServer), true);
 	SH_REMOVE_HOOK(IServerGameClients, ClientConnect, g_pSource2GameClients, SH_MEMBER(this, &MultiAddonManager::Hook_ClientConnect), false);
@@ -433,7 +454,8 @@ bool MultiAddonManager::Unload(char *error, size_t maxlen)
 
 void *MultiAddonManager::OnMetamodQuery(const char *iface, int *ret)
 {
-	if (V_strcmp(iface, MULTIADDONMANAGER_INTERFACE))
+	// Newer versions only append to the interface, so plugins built against an older one keep working
+	if (V_strcmp(iface, MULTIADDONMANAGER_INTERFACE) && V_strcmp(iface, "MultiAddonManager003"))
 	{
 		if (ret)
 			*ret = META_IFACE_FAILED;
@@ -447,30 +469,40 @@ void *MultiAddonManager::OnMetamodQuery(const char *iface, int *ret)
 	return static_cast<IMultiAddonManager*>(&g_MultiAddonManager);
 }
 
-void MultiAddonManager::BuildAddonPath(const char *pszAddon, char *buf, size_t len, bool bLegacy = false)
+void MultiAddonManager::BuildAddonPath(PublishedFileId_t addon, char *buf, size_t len, bool bLegacy = false)
 {
+	const char *pszAddon = g_AddonRegistry.GetName(addon);
+
 	// The workshop on a dedicated server is stored relative to the working directory for whatever reason
-	static CBufferStringGrowable<MAX_PATH> s_sWorkingDir;
-	ExecuteOnce(g_pFullFileSystem->GetSearchPath("EXECUTABLE_PATH", GET_SEARCH_PATH_ALL, s_sWorkingDir, 1));
+	if (m_sWorkingDir.empty())
+	{
+		CBufferStringGrowable<MAX_PATH> sWorkingDir;
+		g_pFullFileSystem->GetSearchPath("EXECUTABLE_PATH", GET_SEARCH_PATH_ALL, sWorkingDir, 1);
+		m_sWorkingDir = sWorkingDir.Get();
+	}
 
-	V_snprintf(buf, len, "%ssteamapps/workshop/content/730/%s/%s%s.vpk", s_sWorkingDir.Get(), pszAddon, pszAddon, bLegacy ? "" : "_dir");
+	V_snprintf(buf, len, "%ssteamapps/workshop/content/730/%s/%s%s.vpk", m_sWorkingDir.c_str(), pszAddon, pszAddon, bLegacy ? "" : "_dir");
 }
 
-bool MultiAddonManager::MountAddon(const char *pszAddon, bool bAddToTail = false)
+bool MultiAddonManager::MountAddon(PublishedFileId_t addon, bool bAddToTail = false)
 {
-	if (!pszAddon || !*pszAddon)
+	if (!CAddonRegistry::IsWorkshopAddon(addon))
 		return false;
 
-	CUtlVector<std::string> serverMountedAddons;
-	StringToVector(this->m_sCurrentWorkshopMap.c_str(), serverMountedAddons);
-	if (serverMountedAddons.Find(pszAddon) != -1)
+	const char *pszAddon = g_AddonRegistry.GetName(addon);
+
+	if (m_WorkshopMapAddons.Has(addon))
 	{
 		Message("%s: Addon %s is already mounted by the server\n", __func__, pszAddon);
 		return false;
 	}
 
-	PublishedFileId_t iAddon = V_StringToUint64(pszAddon, 0);
-	uint32 iAddonState = GetSteamUGC()->GetItemState(iAddon);
+	const ResolvedAddon_t *pResolved = ResolveAddon(addon);
+
+	if (!pResolved)
+		return false;
+
+	uint32 iAddonState = pResolved->m_nItemState;
 
 	if (iAddonState & k_EItemStateLegacyItem)
 	{
@@ -481,113 +513,341 @@ bool MultiAddonManager::MountAddon(const char *pszAddon, bool bAddToTail = false
 	if (!(iAddonState & k_EItemStateInstalled))
 	{
 		Message("%s: Addon %s is not installed, queuing a download\n", __func__, pszAddon);
-		DownloadAddon(pszAddon, true, true);
+		DownloadAddon(addon, true, true);
 		return false;
 	}
-	else if (mm_addon_mount_download.Get())
-	{
-		// Queue a download anyway in case the addon got an update and the server desires this, but don't reload the map when done
-		DownloadAddon(pszAddon, false, true);
-	}
 
-	char pszPath[MAX_PATH];
-	BuildAddonPath(pszAddon, pszPath, sizeof(pszPath));
+	const char *pszPath = pResolved->m_sPath.c_str();
 
-	if (!g_pFullFileSystem->FileExists(pszPath))
+	if (!pResolved->m_bFound)
 	{
-		// This might be a legacy addon (before mutli-chunk was introduced), try again without the _dir
-		BuildAddonPath(pszAddon, pszPath, sizeof(pszPath), true);
+		Panic("%s: Addon %s not found at %s\n", __func__, pszAddon, pszPath);
 
-		if (!g_pFullFileSystem->FileExists(pszPath))
-		{
-			Panic("%s: Addon %s not found at %s\n", __func__, pszAddon, pszPath);
-			return false;
-		}
-	}
-	else
-	{
-		// We still need it without _dir anyway because the filesystem will append suffixes if needed
-		BuildAddonPath(pszAddon, pszPath, sizeof(pszPath), true);
+		// Look again next time, whatever happened to the files might get fixed without a download
+		ForgetResolvedAddon(addon);
+		return false;
 	}
 
-	if (m_MountedAddons.Find(pszAddon) != -1)
+	if (m_MountedAddons.Has(addon))
 	{
 		Panic("%s: Addon %s is already mounted\n", __func__, pszAddon);
 		return false;
 	}
 
+	if (mm_addon_debug.Get())
+		Message("%s: Addon %s is %s with %i chunks, %.2f MB\n", __func__, pszAddon, pResolved->m_bLegacy ? "a legacy VPK" : "a multi-chunk VPK",
+			pResolved->m_nChunks, (double)pResolved->m_Stamp.m_nSizeOnDisk / 1024 / 1024);
+
 	Message("Adding search path: %s\n", pszPath);
 
 	g_pFullFileSystem->AddSearchPath(pszPath, "GAME", bAddToTail ? PATH_ADD_TO_TAIL : PATH_ADD_TO_HEAD, SEARCH_PATH_PRIORITY_VPK);
-	m_MountedAddons.AddToTail(pszAddon);
+	m_MountedAddons.AddToTail(addon);
+	BumpAddonGeneration();
 
 	return true;
 }
 
-bool MultiAddonManager::UnmountAddon(const char *pszAddon)
+bool MultiAddonManager::UnmountAddon(PublishedFileId_t addon)
 {
-	if (!pszAddon || !*pszAddon)
+	if (!addon)
 		return false;
 
 	char path[MAX_PATH];
-	BuildAddonPath(pszAddon, path, sizeof(path));
+	BuildAddonPath(addon, path, sizeof(path));
 
 	if (!g_pFullFileSystem->RemoveSearchPath(path, "GAME"))
 		return false;
 
-	m_MountedAddons.FindAndFastRemove(pszAddon);
+	m_MountedAddons.Remove(addon);
+	BumpAddonGeneration();
 
 	Message("Removing search path: %s\n", path);
 
 	return true;
 }
 
-void MultiAddonManager::PrintDownloadProgress()
+// Poll the progress of every download in flight, once a second
+void MultiAddonManager::UpdateDownloadProgress()
+{
+	// How far back the throughput average reaches, roughly
+	static constexpr double k_flRateWindow = 10.0;
+
+	double flTime = Plat_FloatTime();
+
+	if (m_Downloads.CountInFlight() == 0 || !g_pWorkshopBackend->IsAvailable())
+	{
+		m_flDownloadRate = 0.0;
+		m_flLastDownloadSample = 0.0;
+		return;
+	}
+
+	uint64 nNewBytes = 0;
+
+	m_Downloads.ForEach([&](DownloadItem_t &item)
+	{
+		if (item.m_eState != EDownloadState::InFlight)
+			return;
+
+		uint64 iBytesDownloaded = 0;
+		uint64 iTotalBytes = 0;
+		g_pWorkshopBackend->GetItemDownloadInfo(item.m_nAddon, &iBytesDownloaded, &iTotalBytes);
+
+		if (iTotalBytes)
+			item.m_nTotalBytes = iTotalBytes;
+
+		if (iBytesDownloaded != item.m_nLastBytes)
+		{
+			// It can go backwards when a download restarts
+			if (iBytesDownloaded > item.m_nLastBytes)
+				nNewBytes += iBytesDownloaded - item.m_nLastBytes;
+
+			item.m_nLastBytes = iBytesDownloaded;
+			item.m_flLastProgressTime = flTime;
+		}
+	});
+
+	if (m_flLastDownloadSample > 0.0)
+	{
+		double flDelta = flTime - m_flLastDownloadSample;
+		double flAlpha = 1.0 - exp(-flDelta / k_flRateWindow);
+
+		m_flDownloadRate += flAlpha * ((double)nNewBytes / flDelta - m_flDownloadRate);
+	}
+
+	m_flLastDownloadSample = flTime;
+}
+
+bool MultiAddonManager::GetDownloadProgress(AddonDownloadProgress_t *pProgress)
+{
+	*pProgress = {};
+	pProgress->flSecondsRemaining = -1.0;
+
+	if (m_Downloads.Count() == 0)
+		return false;
+
+	bool bOnlyImportant = m_Downloads.CountImportant() > 0;
+	uint64 nRemainingBytes = 0;
+
+	m_Downloads.ForEach([&](const DownloadItem_t &item)
+	{
+		pProgress->nDownloads++;
+
+		if (item.m_eState == EDownloadState::InFlight)
+			pProgress->nInProgress++;
+
+		if (!item.m_nTotalBytes)
+			return;
+
+		uint64 nBytesDownloaded = MIN(item.m_nLastBytes, item.m_nTotalBytes);
+		pProgress->nBytesDownloaded += nBytesDownloaded;
+		pProgress->nTotalBytes += item.m_nTotalBytes;
+
+		if (item.m_bImportant || !bOnlyImportant)
+			nRemainingBytes += item.m_nTotalBytes - nBytesDownloaded;
+	});
+
+	pProgress->flBytesPerSecond = m_flDownloadRate;
+
+	if (m_flDownloadRate > 0.0)
+		pProgress->flSecondsRemaining = (double)nRemainingBytes / m_flDownloadRate;
+
+	return true;
+}
+
+// Only prints every so often depending on how long the downloads have left, unless bVerbose is set which also lists every download
+void MultiAddonManager::PrintDownloadProgress(bool bVerbose)
+{
+	AddonDownloadProgress_t progress;
+
+	if (!GetDownloadProgress(&progress))
+	{
+		if (bVerbose)
+			Message("No addon downloads in progress\n");
+
+		return;
+	}
+
+	double flTime = Plat_FloatTime();
+
+	if (!bVerbose && flTime < m_flNextProgressPrint)
+		return;
+
+	// Long downloads don't need to flood the console, short ones are done before it matters
+	double flInterval = progress.flSecondsRemaining < 0.0 ? 5.0 : std::clamp(progress.flSecondsRemaining / 10.0, 2.0, 30.0);
+	m_flNextProgressPrint = flTime + flInterval;
+
+	char szETA[32] = "unknown";
+
+	if (progress.flSecondsRemaining >= 0.0)
+		V_snprintf(szETA, sizeof(szETA), "%.0f seconds", progress.flSecondsRemaining);
+
+	Message("Downloading %i addons (%i in progress): %.2f/%.2f MB, %.2f MB/s, %s left\n", progress.nDownloads, progress.nInProgress,
+		(double)progress.nBytesDownloaded / 1024 / 1024, (double)progress.nTotalBytes / 1024 / 1024, progress.flBytesPerSecond / 1024 / 1024, szETA);
+
+	if (!bVerbose && !mm_addon_debug.Get())
+		return;
+
+	m_Downloads.ForEach([](const DownloadItem_t &item)
+	{
+		double flMBDownloaded = (double)item.m_nLastBytes / 1024 / 1024;
+		double flTotalMB = (double)item.m_nTotalBytes / 1024 / 1024;
+		double flProgress = item.m_nTotalBytes ? (double)item.m_nLastBytes / (double)item.m_nTotalBytes * 100.0 : 0.0;
+
+		Message("  Addon %lli: %s%s, attempt %i, %.2f/%.2f MB (%.2f%%)\n", item.m_nAddon, item.m_eState == EDownloadState::InFlight ? "downloading" : "queued",
+			item.m_bImportant ? " (reloads map)" : "", item.m_nAttempts, flMBDownloaded, flTotalMB, flProgress);
+	});
+}
+
+static DownloadRetryPolicy_t GetDownloadRetryPolicy()
 {
-	if (m_DownloadQueue.Count() == 0)
+	return { mm_addon_download_retries.Get(), (double)mm_addon_download_retry_delay.Get() };
+}
+
+// Start as many queued downloads as mm_addon_download_max_concurrent allows
+void MultiAddonManager::StartQueuedDownloads()
+{
+	if (!g_pWorkshopBackend->IsAvailable())
 		return;
 
-	uint64 iBytesDownloaded = 0;
-	uint64 iTotalBytes = 0;
+	std::vector<DownloadEvent_t> events;
+	m_Downloads.StartQueued(g_pWorkshopBackend, mm_addon_download_max_concurrent.Get(), GetDownloadRetryPolicy(), Plat_FloatTime(), events);
+
+	for (const DownloadEvent_t &event : events)
+	{
+		PublishedFileId_t addon = event.m_Item.m_nAddon;
+
+		if (event.m_eEvent == EDownloadEvent::Started)
+		{
+			if (event.m_Item.m_nAttempts > 1)
+				Message("Addon download restarted for %lli (attempt %i)\n", addon, event.m_Item.m_nAttempts);
+			else
+				Message("Addon download started for %lli\n", addon);
+
+			continue;
+		}
+
+		Panic("%s: Addon download for %lli failed to start, addon ID is invalid or server is not logged on Steam\n", __func__, addon);
+
+		if (event.m_eEvent == EDownloadEvent::Retrying)
+		{
+			Message("Retrying addon %lli download in %.1f seconds\n", addon, event.m_flRetryDelay);
+			continue;
+		}
+
+		// Out of attempts, finish it like any other failed download so a reload waiting on it isn't held up forever
+		Panic("%s: Giving up on addon %lli after %i attempts\n", __func__, addon, event.m_Item.m_nAttempts);
+		OnDownloadFinished(event.m_Item);
+	}
+}
+
+// Queue the download again with exponential backoff, returns false if it's out of attempts
+bool MultiAddonManager::RetryDownload(PublishedFileId_t addon)
+{
+	DownloadItem_t *pItem = m_Downloads.Find(addon);
+
+	if (!pItem)
+		return false;
+
+	double flDelay;
 
-	if (!GetSteamUGC()->GetItemDownloadInfo(m_DownloadQueue.Head(), &iBytesDownloaded, &iTotalBytes) || !iTotalBytes)
+	if (!m_Downloads.Retry(addon, GetDownloadRetryPolicy(), Plat_FloatTime(), flDelay))
+	{
+		Panic("%s: Giving up on addon %lli after %i attempts\n", __func__, addon, pItem->m_nAttempts);
+		return false;
+	}
+
+	Message("Retrying addon %lli download in %.1f seconds\n", addon, flDelay);
+
+	return true;
+}
+
+// Restart in-flight downloads whose downloaded bytes haven't moved for mm_addon_download_stall_timeout, relies on UpdateDownloadProgress
+void MultiAddonManager::CheckStalledDownloads()
+{
+	float flTimeout = mm_addon_download_stall_timeout.Get();
+
+	if (flTimeout <= 0.f || m_Downloads.CountInFlight() == 0)
 		return;
 
-	double flMBDownloaded = (double)iBytesDownloaded / 1024 / 1024;
-	double flTotalMB = (double)iTotalBytes / 1024 / 1024;
+	double flTime = Plat_FloatTime();
+	bool bAnyProgress = false;
+	std::vector<PublishedFileId_t> stalled;
+	std::vector<PublishedFileId_t> notStarted;
+
+	m_Downloads.ForEach([&](DownloadItem_t &item)
+	{
+		if (item.m_eState != EDownloadState::InFlight)
+			return;
+
+		if (flTime - item.m_flLastProgressTime <= flTimeout)
+			bAnyProgress = true;
+		else if (item.m_nTotalBytes)
+			stalled.push_back(item.m_nAddon);
+		else
+			notStarted.push_back(item.m_nAddon);
+	});
+
+	// Steam works through downloads on its own terms, one that hasn't started isn't stalled as long as another is moving
+	if (!bAnyProgress)
+		stalled.insert(stalled.end(), notStarted.begin(), notStarted.end());
+
+	for (PublishedFileId_t addon : stalled)
+	{
+		Panic("%s: Addon %lli download made no progress in %.0f seconds\n", __func__, addon, flTimeout);
 
-	double flProgress = (double)iBytesDownloaded / (double)iTotalBytes;
-	flProgress *= 100.f;
+		if (!RetryDownload(addon))
+		{
+			DownloadItem_t item;
+			m_Downloads.Remove(addon, &item);
+			OnDownloadFinished(item);
+		}
+	}
+}
 
-	Message("Downloading addon %lli: %.2f/%.2f MB (%.2f%%)\n", m_DownloadQueue.Head(), flMBDownloaded, flTotalMB, flProgress);
+void MultiAddonManager::OnDownloadFinished(const DownloadItem_t &item)
+{
+	// That was the last important download, now reload the map
+	if (item.m_bImportant && m_Downloads.CountImportant() == 0)
+	{
+		Message("All addon downloads finished, reloading map %s\n", gpGlobals->mapname);
+		RequestMapReload();
+	}
 }
 
 // bImportant adds downloads to the pending list, which will reload the current map once the list is exhausted
 // bForce will initiate a download even if the addon already exists and is updated
-// Internally, downloads are queued up and processed one at a time
+// Internally, downloads are queued up and only a few run at a time, see CDownloadScheduler
 bool MultiAddonManager::DownloadAddon(const char *pszAddon, bool bImportant, bool bForce)
 {
-	if (!GetSteamUGC())
+	PublishedFileId_t addon = g_AddonRegistry.Intern(pszAddon);
+
+	if (!CAddonRegistry::IsWorkshopAddon(addon))
 	{
-		Panic("%s: Cannot download addons as the Steam API is not initialized\n", __func__);
+		Panic("%s: Invalid addon %s\n", __func__, pszAddon);
 		return false;
 	}
 
-	PublishedFileId_t addon = V_StringToUint64(pszAddon, 0);
+	return DownloadAddon(addon, bImportant, bForce);
+}
 
-	if (addon == 0)
+bool MultiAddonManager::DownloadAddon(PublishedFileId_t addon, bool bImportant, bool bForce)
+{
+	if (!g_pWorkshopBackend->IsAvailable())
 	{
-		Panic("%s: Invalid addon %s\n", __func__, pszAddon);
+		Panic("%s: Cannot download addons as the Steam API is not initialized\n", __func__);
 		return false;
 	}
 
-	if (m_DownloadQueue.Check(addon))
+	if (m_Downloads.Find(addon))
 	{
-		Panic("%s: Addon %s is already queued for download!\n", __func__, pszAddon);
+		// Still make it count towards the map reload if it's now needed for that
+		m_Downloads.Queue(addon, bImportant, Plat_FloatTime());
+
+		Panic("%s: Addon %lli is already queued for download!\n", __func__, addon);
 		return false;
 	}
 
-	uint32 nItemState = GetSteamUGC()->GetItemState(addon);
+	uint32 nItemState = g_pWorkshopBackend->GetItemState(addon);
 
 	if (!bForce && (nItemState & k_EItemStateInstalled))
 	{
@@ -595,267 +855,767 @@ bool MultiAddonManager::DownloadAddon(const char *pszAddon, bool bImportant, boo
 		return true;
 	}
 
-	if (!GetSteamUGC()->DownloadItem(addon, false))
-	{
-		Panic("%s: Addon download for %lli failed to start, addon ID is invalid or server is not logged on Steam\n", __func__, addon);
-		return false;
-	}
-	
-	if (bImportant && m_ImportantDownloads.Find(addon) == -1)
-		m_ImportantDownloads.AddToTail(addon);
+	m_Downloads.Queue(addon, bImportant, Plat_FloatTime());
+	StartQueuedDownloads();
+
+	DownloadItem_t *pItem = m_Downloads.Find(addon);
+
+	// It failed to start right away
+	if (!pItem)
+		return false;
+
+	if (pItem->m_eState == EDownloadState::Queued && pItem->m_nAttempts == 0)
+		Message("Addon download queued for %lli, %i downloads already in progress\n", addon, m_Downloads.CountInFlight());
+
+	return true;
+}
+
+void MultiAddonManager::RefreshAddons(bool bReloadMap, bool bRemountAll)
+{
+	if (!g_pWorkshopBackend->IsAvailable())
+	{
+		MountFromManifest();
+		return;
+	}
+
+	Message("Refreshing addons (%s)\n", m_ExtraAddons.ToString().c_str());
+
+	// Switching workshop maps resets the search path stack around ours, so start from scratch to get the same stack clients build
+	if (m_sMountedWorkshopMap != m_sCurrentWorkshopMap)
+		bRemountAll = true;
+
+	m_sMountedWorkshopMap = m_sCurrentWorkshopMap;
+
+	// Otherwise the list changed mid-map, only touch the search paths that actually change. Addons are mounted at the head in list order
+	// so the last one ends up on top, and since paths can only be added at the head, everything above the first difference with the new
+	// order has to be remounted. Addons which are simply gone from the list can be removed from anywhere, and the matching bottom of the
+	// stack stays as is.
+	for (int i = m_MountedAddons.Count() - 1; i >= 0; i--)
+	{
+		if (!m_ExtraAddons.Has(m_MountedAddons[i]))
+			UnmountAddon(m_MountedAddons[i]);
+	}
+
+	int nKept = 0;
+	while (!bRemountAll && nKept < m_MountedAddons.Count() && nKept < m_ExtraAddons.Count() && m_MountedAddons[nKept] == m_ExtraAddons[nKept])
+		nKept++;
+
+	// Now that Steam is here, make sure what was mounted from the manifest is still what's installed, and get any updates
+	for (int i = 0; i < nKept; i++)
+	{
+		PublishedFileId_t addon = m_MountedAddons[i];
+
+		if (!m_ManifestAddons.Has(addon))
+			continue;
+
+		EManifestAddonState eState = CMountManifest::Check(g_pWorkshopBackend, addon);
+		const ResolvedAddon_t *pResolved = ResolveAddon(addon);
+
+		if (eState == EManifestAddonState::Stale || !pResolved || !pResolved->m_bFound)
+		{
+			nKept = i;
+			break;
+		}
+
+		if (eState == EManifestAddonState::NeedsUpdate && !m_Downloads.Find(addon))
+			DownloadAddon(addon, true, true);
+	}
+
+	m_ManifestAddons.RemoveAll();
+
+	for (int i = m_MountedAddons.Count() - 1; i >= nKept; i--)
+		UnmountAddon(m_MountedAddons[i]);
+
+	if (mm_addon_debug.Get())
+		Message("%s: Keeping %i addons mounted, mounting %i\n", __func__, nKept, m_ExtraAddons.Count() - nKept);
+
+	bool bAllAddonsMounted = true;
+
+	for (int i = nKept; i < m_ExtraAddons.Count(); i++)
+	{
+		if (!MountAddon(m_ExtraAddons[i]))
+			bAllAddonsMounted = false;
+	}
+
+	if (mm_addon_debug.Get())
+		VerifyMountOrder();
+
+	SaveMountManifest();
+
+	if (mm_addon_mount_download.Get())
+		CheckForUpdates();
+
+	if (!bAllAddonsMounted || !bReloadMap)
+		return;
+
+	// Typically on boot, where the addons could already be mounted when the map started if Steam was up by then
+	if (m_MountedAddons == m_MapStartAddons && !m_bMountedAddonUpdated)
+	{
+		Message("Addons are the same as when the map started, no need to reload it\n");
+		return;
+	}
+
+	RequestMapReload();
+}
+
+// Checks that our search paths are stacked the way clients stack the addons, with the last one in the list on top.
+// Paths the filesystem reports in another form than we mounted them with can't be found and are skipped
+void MultiAddonManager::VerifyMountOrder()
+{
+	CBufferStringGrowable<MAX_PATH * 8> sSearchPaths;
+	g_pFullFileSystem->GetSearchPath("GAME", GET_SEARCH_PATH_ALL, sSearchPaths, 1024);
+
+	const char *pszSearchPaths = sSearchPaths.Get();
+	const char *pszAbove = nullptr;
+	PublishedFileId_t above = 0;
+
+	for (int i = m_MountedAddons.Count() - 1; i >= 0; i--)
+	{
+		PublishedFileId_t addon = m_MountedAddons[i];
+		const ResolvedAddon_t *pResolved = ResolveAddon(addon);
+		const char *pszFound = pResolved ? V_stristr(pszSearchPaths, pResolved->m_sPath.c_str()) : nullptr;
+
+		if (!pszFound)
+			continue;
+
+		if (pszAbove && pszFound < pszAbove)
+		{
+			Panic("%s: Addon %s is above %s in the search paths but clients mount it below, the search paths are:\n%s\n", __func__,
+				g_AddonRegistry.GetName(addon), g_AddonRegistry.GetName(above), pszSearchPaths);
+			return;
+		}
+
+		pszAbove = pszFound;
+		above = addon;
+	}
+}
+
+void MultiAddonManager::ClearAddons()
+{
+	m_ExtraAddons.RemoveAll();
+
+	// Update the convar to reflect the new addon list, but don't trigger the callback
+	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = "";
+	
+	for (int i = m_MountedAddons.Count() - 1; i >= 0; i--)
+		UnmountAddon(m_MountedAddons[i]);
+}
+
+void MultiAddonManager::Hook_GameServerSteamAPIActivated()
+{
+	// This is only intended for dedicated servers
+	if (!g_pEngineServer->IsDedicatedServer())
+		RETURN_META(MRES_IGNORED);
+
+	Message("Steam API Activated\n");
+
+	m_CallbackDownloadItemResult.Register(this, &MultiAddonManager::OnAddonDownloaded);
+
+	RefreshAddons(true);
+
+	RETURN_META(MRES_IGNORED);
+}
+
+void MultiAddonManager::ReloadMap()
+{
+	char cmd[MAX_PATH];
+
+	// Using the concommand here as g_pEngineServer->ChangeLevel doesn't unmount workshop maps and we wanna be clean.
+	// See Hook_SetPendingHostStateRequest's comment for more details.
+	// Community maps are treated like workshop maps but they should still be loaded using changelevel
+	if (m_sCurrentWorkshopMap.empty() || g_pFullFileSystem->IsDirectory(m_sCurrentWorkshopMap.c_str(), "OFFICIAL_ADDONS"))
+		V_snprintf(cmd, sizeof(cmd), "changelevel %s", gpGlobals->mapname.ToCStr());
+	else
+		V_snprintf(cmd, sizeof(cmd), "host_workshop_map %s", m_sCurrentWorkshopMap.c_str());
+
+	g_pEngineServer->ServerCommand(cmd);
+}
+
+// Reloads are expensive as every player has to reconnect, so requests that come in close to each other are merged into one.
+// Each request pushes the reload back by mm_addon_reload_delay, up to a few times that since the first one.
+void MultiAddonManager::RequestMapReload()
+{
+	float flDelay = mm_addon_reload_delay.Get();
+	double flTime = Plat_FloatTime();
+
+	if (flDelay <= 0.f && m_Downloads.CountImportant() == 0)
+	{
+		m_flReloadTime = 0.0;
+		ReloadMap();
+		return;
+	}
+
+	if (m_flReloadTime == 0.0)
+		m_flFirstReloadRequest = flTime;
+
+	m_flReloadTime = MIN(flTime + flDelay, m_flFirstReloadRequest + flDelay * 4);
+}
+
+void MultiAddonManager::UpdatePendingReload()
+{
+	if (m_flReloadTime == 0.0 || Plat_FloatTime() < m_flReloadTime)
+		return;
+
+	m_flReloadTime = 0.0;
+
+	// Important downloads were queued in the meantime, the last of them to finish requests the reload again
+	if (m_Downloads.CountImportant() > 0)
+	{
+		Message("Delaying the map reload until %i more addon downloads are finished\n", m_Downloads.CountImportant());
+		return;
+	}
+
+	ReloadMap();
+}
+
+void MultiAddonManager::OnAddonDownloaded(DownloadItemResult_t *pResult)
+{
+	// Whatever the result, the files and install state might be different now
+	ForgetResolvedAddon(pResult->m_nPublishedFileId);
+
+	if (pResult->m_eResult == k_EResultOK)
+	{
+		Message("Addon %lli downloaded successfully\n", pResult->m_nPublishedFileId);
+		InvalidateStaleDownloads(pResult->m_nPublishedFileId);
+
+		if (m_MountedAddons.Has(pResult->m_nPublishedFileId))
+			m_bMountedAddonUpdated = true;
+	}
+	else
+		Panic("Addon %lli download failed with reason \"%s\" (%i)\n", pResult->m_nPublishedFileId, GetSteamResultMessage(pResult->m_eResult), pResult->m_eResult);
+
+	// This download isn't triggered by us, don't do anything
+	if (!m_Downloads.Find(pResult->m_nPublishedFileId))
+		return;
+
+	if (pResult->m_eResult != k_EResultOK)
+	{
+		if (!IsRetryableSteamResult(pResult->m_eResult))
+			Panic("Addon %lli download failed permanently, not retrying\n", pResult->m_nPublishedFileId);
+		else if (RetryDownload(pResult->m_nPublishedFileId))
+		{
+			StartQueuedDownloads();
+			return;
+		}
+	}
+
+	DownloadItem_t item;
+	m_Downloads.Remove(pResult->m_nPublishedFileId, &item);
+
+	// Completions can arrive in any order, fill the slot this one freed
+	StartQueuedDownloads();
+
+	OnDownloadFinished(item);
+}
+
+bool MultiAddonManager::AddAddon(const char *pszAddon, bool bRefresh)
+{
+	PublishedFileId_t addon = g_AddonRegistry.Intern(pszAddon);
+
+	if (!addon)
+	{
+		Panic("Addon %s is invalid!\n", pszAddon);
+		return false;
+	}
+
+	if (m_ExtraAddons.Has(addon))
+	{
+		Panic("Addon %s is already in the list!\n", pszAddon);
+		return false;
+	}
+
+	Message("Adding %s to addon list\n", pszAddon);
+
+	m_ExtraAddons.AddToTail(addon);
+
+	// Update the convar to reflect the new addon list, but don't trigger the callback
+	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = m_ExtraAddons.ToString().c_str();
+
+	Message("Clearing client cache due to addons changing\n");
+
+	if (bRefresh)
+		RefreshAddons();
+
+	return true;
+}
+
+bool MultiAddonManager::RemoveAddon(const char *pszAddon, bool bRefresh)
+{
+	if (!m_ExtraAddons.Remove(g_AddonRegistry.Find(pszAddon)))
+	{
+		Panic("Addon %s is not in the list!\n", pszAddon);
+		return false;
+	}
+
+	Message("Removing %s from addon list\n", pszAddon);
+
+	// Update the convar to reflect the new addon list, but don't trigger the callback
+	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = m_ExtraAddons.ToString().c_str();
+
+	if (bRefresh)
+		RefreshAddons();
+
+	return true;
+}
+
+bool MultiAddonManager::IsAddonMounted(const char *pszAddon, bool bCheckWorkshopMap)
+{
+	PublishedFileId_t addon = g_AddonRegistry.Find(pszAddon);
+
+	return m_MountedAddons.Has(addon) || (bCheckWorkshopMap && m_WorkshopMapAddons.Has(addon));
+}
+
+void MultiAddonManager::SetCurrentWorkshopMap(const char *pszWorkshopID)
+{
+	if (m_sCurrentWorkshopMap == pszWorkshopID)
+		return;
+
+	m_sCurrentWorkshopMap = pszWorkshopID;
+	m_WorkshopMapAddons.FromString(pszWorkshopID);
+	BumpAddonGeneration();
+}
+
+void MultiAddonManager::ClearCurrentWorkshopMap()
+{
+	if (m_sCurrentWorkshopMap.empty())
+		return;
+
+	m_sCurrentWorkshopMap.clear();
+	m_WorkshopMapAddons.RemoveAll();
+	BumpAddonGeneration();
+}
+
+CNetMessagePB<CNETMsg_SignonState> *GetAddonSignonStateMessage(const char *pszAddon)
+{
+	if (!gpGlobals)
+		return nullptr;
+
+	INetworkMessageInternal *pNetMsg = g_pNetworkMessages->FindNetworkMessagePartial("SignonState");
+	CNetMessagePB<CNETMsg_SignonState> *pMsg = pNetMsg->AllocateMessage()->ToPB<CNETMsg_SignonState>();
+	pMsg->set_spawn_count(gpGlobals->serverCount);
+	pMsg->set_signon_state(SIGNONSTATE_CHANGELEVEL);
+	pMsg->set_addons(pszAddon ? pszAddon : "");
+	pMsg->set_num_server_players(GetClientList()->Count());
+	for (int i = 0; i < GetClientList()->Count(); i++)
+	{
+		auto client = GetClientList()->Element(i);
+
+		char const *szNetworkId = g_pEngineServer->GetPlayerNetworkIDString(client->GetPlayerSlot());
+
+		pMsg->add_players_networkids(szNetworkId);
+	}
+
+	return pMsg;
+}
+
+void MultiAddonManager::OpenClientDownloadCache()
+{
+	char szPath[MAX_PATH];
+	const char *pszSharedFile = mm_cache_clients_shared_file.Get().Get();
+	bool bShared = pszSharedFile && *pszSharedFile;
+
+	// Nothing reads or writes the file unless one of these is set, so don't touch the disk for it
+	if (!mm_cache_clients_with_addons.Get() && !bShared)
+	{
+		g_ClientDownloadCache.Close();
+		return;
+	}
+
+	if (bShared)
+		V_strncpy(szPath, pszSharedFile, sizeof(szPath));
+	else
+		V_snprintf(szPath, sizeof(szPath), "%s/addons/multiaddonmanager/clientcache.bin", g_SMAPI->GetBaseDir());
+
+	if (!g_ClientDownloadCache.Open(szPath, (uint32)std::max(mm_cache_clients_file_entries.Get(), 0), bShared))
+	{
+		// Not fatal, clients are still cached in memory for as long as the server runs
+		g_ClientDownloadCache.Close();
+		Message("%s: Could not open the client download cache at %s, falling back to the in-memory cache only\n", __func__, szPath);
+	}
+}
+
+static void GetMountManifestPath(char *buf, size_t len)
+{
+	V_snprintf(buf, len, "%s/addons/multiaddonmanager/mounted.txt", g_SMAPI->GetBaseDir());
+}
+
+// Remember what's mounted and in which order, so the next boot can mount it before Steam is up
+void MultiAddonManager::SaveMountManifest()
+{
+	CMountManifest manifest;
+
+	for (int i = 0; i < m_MountedAddons.Count(); i++)
+	{
+		const ResolvedAddon_t *pResolved = ResolveAddon(m_MountedAddons[i]);
+
+		if (!pResolved || !pResolved->m_bFound)
+			break;
+
+		MountManifestEntry_t entry { m_MountedAddons[i], pResolved->m_bLegacy, 0, 0, pResolved->m_sPath };
+
+		if (!Plat_GetFileInfo(MountManifestEntry_t::GetCheckPath(entry.m_sPath, entry.m_bLegacy).c_str(), entry.m_nSize, entry.m_nModifiedTime))
+			break;
+
+		manifest.Add(entry);
+	}
+
+	char szPath[MAX_PATH];
+	GetMountManifestPath(szPath, sizeof(szPath));
+
+	if (!manifest.Write(szPath))
+		Panic("%s: Failed to write %s\n", __func__, szPath);
+}
+
+// Steam isn't up yet, mount what was mounted last time straight from disk as long as the files haven't changed since.
+// RefreshAddons checks them against Steam once it's available.
+void MultiAddonManager::MountFromManifest()
+{
+	if (!m_MountedAddons.IsEmpty() || m_ExtraAddons.IsEmpty())
+		return;
+
+	char szPath[MAX_PATH];
+	GetMountManifestPath(szPath, sizeof(szPath));
+
+	CMountManifest manifest;
+
+	if (!manifest.Read(szPath))
+		return;
+
+	// Mount in list order and stop at the first addon we can't vouch for
+	int nMountable = manifest.CountMountable(m_ExtraAddons.GetAddons(), [](const MountManifestEntry_t &entry)
+	{
+		uint64_t nSize;
+		int64_t nModifiedTime;
+
+		if (Plat_GetFileInfo(MountManifestEntry_t::GetCheckPath(entry.m_sPath, entry.m_bLegacy).c_str(), nSize, nModifiedTime)
+			&& nSize == entry.m_nSize && nModifiedTime == entry.m_nModifiedTime)
+			return true;
+
+		Message("Addon %s changed on disk since it was last mounted, waiting for Steam to mount it\n", g_AddonRegistry.GetName(entry.m_nAddon));
+		return false;
+	});
+
+	for (int i = 0; i < nMountable; i++)
+	{
+		PublishedFileId_t addon = m_ExtraAddons[i];
+		const MountManifestEntry_t *pEntry = manifest.Find(addon);
+
+		Message("Adding search path before Steam is up: %s\n", pEntry->m_sPath.c_str());
+
+		g_pFullFileSystem->AddSearchPath(pEntry->m_sPath.c_str(), "GAME", PATH_ADD_TO_HEAD, SEARCH_PATH_PRIORITY_VPK);
+		m_MountedAddons.AddToTail(addon);
+		m_ManifestAddons.AddToTail(addon);
+	}
+
+	if (!m_ManifestAddons.IsEmpty())
+	{
+		m_sMountedWorkshopMap = m_sCurrentWorkshopMap;
+		BumpAddonGeneration();
+	}
+}
+
+// One batched workshop query for every mounted addon, only those with a newer version than what's installed get downloaded.
+// Like before, these downloads don't reload the map, the update is picked up on the next one.
+void MultiAddonManager::CheckForUpdates()
+{
+	std::vector<PublishedFileId_t> addons;
+
+	for (int i = 0; i < m_MountedAddons.Count(); i++)
+	{
+		if (!m_Downloads.Find(m_MountedAddons[i]))
+			addons.push_back(m_MountedAddons[i]);
+	}
+
+	if (addons.empty())
+		return;
+
+	bool bSent = g_pWorkshopBackend->QueryItemDetails(addons, [this](const std::vector<WorkshopItemDetails_t> &details)
+	{
+		for (const WorkshopItemDetails_t &item : details)
+		{
+			// Addons that aren't installed are already being downloaded by MountAddon
+			AddonInstallStamp_t stamp = GetAddonInstallStamp(item.m_nAddon);
+
+			if (!item.m_bFound || !stamp.m_nTimeUpdated || item.m_nTimeUpdated <= stamp.m_nTimeUpdated || m_Downloads.Find(item.m_nAddon))
+				continue;
+
+			Message("Addon %lli has an update on the workshop, downloading it\n", item.m_nAddon);
+			DownloadAddon(item.m_nAddon, false, true);
+		}
+	});
+
+	if (bSent)
+		return;
+
+	Panic("%s: Failed to query the workshop for updates, downloading every addon instead\n", __func__);
+
+	for (PublishedFileId_t addon : addons)
+		DownloadAddon(addon, false, true);
+}
+
+// Returns nullptr if this isn't a workshop addon or Steam isn't up yet
+const ResolvedAddon_t *MultiAddonManager::ResolveAddon(PublishedFileId_t addon)
+{
+	if (!CAddonRegistry::IsWorkshopAddon(addon) || !g_pWorkshopBackend->IsAvailable())
+		return nullptr;
+
+	int iSlot = g_AddonRegistry.GetSlot(addon);
+
+	if (iSlot >= (int)m_ResolvedAddons.size())
+		m_ResolvedAddons.resize(iSlot + 1);
+
+	ResolvedAddon_t &resolved = m_ResolvedAddons[iSlot];
 
-	m_DownloadQueue.Insert(addon);
+	if (resolved.m_bResolved)
+		return &resolved;
 
-	Message("Addon download started for %lli\n", addon);
+	resolved = {};
+	resolved.m_bResolved = true;
+	resolved.m_nItemState = g_pWorkshopBackend->GetItemState(addon);
 
-	return true;
-}
+	// We always mount it without _dir because the filesystem will append suffixes if needed
+	char szPath[MAX_PATH];
+	BuildAddonPath(addon, szPath, sizeof(szPath), true);
+	resolved.m_sPath = szPath;
 
-void MultiAddonManager::RefreshAddons(bool bReloadMap)
-{
-	if (!GetSteamUGC())
-		return;
+	if (!(resolved.m_nItemState & k_EItemStateInstalled))
+		return &resolved;
 
-	Message("Refreshing addons (%s)\n", VectorToString(m_ExtraAddons).c_str());
+	if (!g_pWorkshopBackend->GetItemInstallInfo(addon, &resolved.m_Stamp.m_nSizeOnDisk, &resolved.m_Stamp.m_nTimeUpdated))
+		resolved.m_Stamp = {};
 
-	// Remove our paths first in case addons were switched
-	FOR_EACH_VEC_BACK(m_MountedAddons, i)
-		UnmountAddon(m_MountedAddons[i].c_str());
+	BuildAddonPath(addon, szPath, sizeof(szPath), false);
 
-	bool bAllAddonsMounted = true;
+	if (g_pFullFileSystem->FileExists(szPath))
+	{
+		// Chunks are numbered from 000 next to the _dir VPK
+		std::string sBase = resolved.m_sPath.substr(0, resolved.m_sPath.size() - 4);
+
+		while (true)
+		{
+			V_snprintf(szPath, sizeof(szPath), "%s_%03d.vpk", sBase.c_str(), resolved.m_nChunks);
+
+			if (!g_pFullFileSystem->FileExists(szPath))
+				break;
+
+			resolved.m_nChunks++;
+		}
 
-	FOR_EACH_VEC(m_ExtraAddons, i)
+		resolved.m_bFound = true;
+	}
+	else if (g_pFullFileSystem->FileExists(resolved.m_sPath.c_str()))
 	{
-		if (!MountAddon(m_ExtraAddons[i].c_str()))
-			bAllAddonsMounted = false;
+		// A legacy addon, from before mutli-chunk was introduced
+		resolved.m_bFound = true;
+		resolved.m_bLegacy = true;
+		resolved.m_nChunks = 1;
 	}
 
-	if (bAllAddonsMounted && bReloadMap)
-		ReloadMap();
+	return &resolved;
 }
 
-void MultiAddonManager::ClearAddons()
+void MultiAddonManager::ForgetResolvedAddon(PublishedFileId_t addon)
 {
-	m_ExtraAddons.RemoveAll();
+	int iSlot = g_AddonRegistry.FindSlot(addon);
 
-	// Update the convar to reflect the new addon list, but don't trigger the callback
-	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = "";
-	
-	FOR_EACH_VEC_BACK(m_MountedAddons, i)
-		UnmountAddon(m_MountedAddons[i].c_str());
+	if (iSlot != -1 && iSlot < (int)m_ResolvedAddons.size())
+		m_ResolvedAddons[iSlot] = {};
 }
 
-void MultiAddonManager::Hook_GameServerSteamAPIActivated()
+// Installed version of a workshop addon, used to tell whether what a client downloaded back then is still current
+AddonInstallStamp_t MultiAddonManager::GetAddonInstallStamp(PublishedFileId_t addon)
 {
-	// This is only intended for dedicated servers
-	if (!g_pEngineServer->IsDedicatedServer())
-		RETURN_META(MRES_IGNORED);
+	const ResolvedAddon_t *pResolved = ResolveAddon(addon);
 
-	Message("Steam API Activated\n");
+	return pResolved ? pResolved->m_Stamp : AddonInstallStamp_t {};
+}
 
-	m_CallbackDownloadItemResult.Register(this, &MultiAddonManager::OnAddonDownloaded);
+// A new version of the addon was just installed, forget it for the clients that downloaded an older one so they get sent the update.
+// Clients which already have this version are left alone.
+void MultiAddonManager::InvalidateStaleDownloads(PublishedFileId_t addon)
+{
+	int iSlot = g_AddonRegistry.FindSlot(addon);
+	if (iSlot == -1)
+		return;
 
-	RefreshAddons(true);
+	AddonInstallStamp_t stamp = GetAddonInstallStamp(addon);
 
-	RETURN_META(MRES_IGNORED);
-}
+	// Can't tell who's stale without knowing the new version, the timestamps in the on-disk cache will catch them next time
+	if (!stamp.m_nTimeUpdated)
+		return;
 
-void MultiAddonManager::ReloadMap()
-{
-	char cmd[MAX_PATH];
+	int nInvalidated = 0;
 
-	// Using the concommand here as g_pEngineServer->ChangeLevel doesn't unmount workshop maps and we wanna be clean.
-	// See Hook_SetPendingHostStateRequest's comment for more details.
-	// Community maps are treated like workshop maps but they should still be loaded using changelevel
-	if (m_sCurrentWorkshopMap.empty() || g_pFullFileSystem->IsDirectory(m_sCurrentWorkshopMap.c_str(), "OFFICIAL_ADDONS"))
-		V_snprintf(cmd, sizeof(cmd), "changelevel %s", gpGlobals->mapname.ToCStr());
-	else
-		V_snprintf(cmd, sizeof(cmd), "host_workshop_map %s", m_sCurrentWorkshopMap.c_str());
+	g_ClientAddons.ForEach([&](uint64 steamID64, ClientAddonInfo_t &clientInfo)
+	{
+		if (!clientInfo.downloadedAddons.IsSet(iSlot))
+			return;
 
-	g_pEngineServer->ServerCommand(cmd);
+		if (iSlot < (int)clientInfo.downloadedStamps.size() && clientInfo.downloadedStamps[iSlot] == stamp)
+			return;
+
+		clientInfo.downloadedAddons.Clear(iSlot);
+		clientInfo.PublishSnapshot();
+		nInvalidated++;
+	});
+
+	if (nInvalidated && mm_addon_debug.Get())
+		Message("%s: Addon %lli was updated, %i cached clients will be sent the new version\n", __func__, addon, nInvalidated);
 }
 
-void MultiAddonManager::OnAddonDownloaded(DownloadItemResult_t *pResult)
+// Fill in a client's downloaded addons from the on-disk cache, for clients we haven't seen since the server started or that got addons on another instance
+void MultiAddonManager::LoadPersistedDownloads(uint64 steamID64, ClientAddonInfo_t &clientInfo, const CAddonList &addons)
 {
-	if (pResult->m_eResult == k_EResultOK)
-		Message("Addon %lli downloaded successfully\n", pResult->m_nPublishedFileId);
-	else
-		Panic("Addon %lli download failed with reason \"%s\" (%i)\n", pResult->m_nPublishedFileId, g_SteamErrorMessages[pResult->m_eResult], pResult->m_eResult);
-
-	// This download isn't triggered by us, don't do anything
-	if (!m_DownloadQueue.Check(pResult->m_nPublishedFileId))
+	// A shared cache is used even without caching, as what's in there was downloaded while connected to another instance
+	if (!(mm_cache_clients_with_addons.Get() || g_ClientDownloadCache.IsShared()) || !g_ClientDownloadCache.IsOpen())
 		return;
 
-	m_DownloadQueue.RemoveAtHead();
-	
-	bool bFound = m_ImportantDownloads.FindAndRemove(pResult->m_nPublishedFileId);
-	
-	// That was the last important download, now reload the map
-	if (bFound && m_ImportantDownloads.Count() == 0)
-	{
-		Message("All addon downloads finished, reloading map %s\n", gpGlobals->mapname);
-		ReloadMap();
-	}
-}
+	uint32 nNow = (uint32)time(nullptr);
+	uint32 nMinLastSeen = mm_cache_clients_duration.Get() > 0 ? nNow - (uint32)mm_cache_clients_duration.Get() : 0;
+	bool bChanged = false;
 
-bool MultiAddonManager::AddAddon(const char *pszAddon, bool bRefresh)
-{
-	if (m_ExtraAddons.Find(pszAddon) != -1)
+	for (int i = 0; i < addons.Count(); i++)
 	{
-		Panic("Addon %s is already in the list!\n", pszAddon);
-		return false;
-	}
+		PublishedFileId_t addon = addons[i];
 
-	Message("Adding %s to addon list\n", pszAddon);
+		if (!CAddonRegistry::IsWorkshopAddon(addon) || clientInfo.downloadedAddons.Has(addon))
+			continue;
 
-	m_ExtraAddons.AddToTail(pszAddon);
+		AddonInstallStamp_t stamp = GetAddonInstallStamp(addon);
 
-	// Update the convar to reflect the new addon list, but don't trigger the callback
-	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = VectorToString(m_ExtraAddons).c_str();
+		if (!stamp.m_nTimeUpdated || !g_ClientDownloadCache.Has(steamID64, addon, stamp.m_nTimeUpdated, nMinLastSeen))
+			continue;
 
-	Message("Clearing client cache due to addons changing");
+		// Keep it fresh so it's not the first to be replaced
+		g_ClientDownloadCache.Set(steamID64, addon, stamp.m_nTimeUpdated, nNow);
 
-	if (bRefresh)
-		RefreshAddons();
+		clientInfo.MarkDownloaded(addon, stamp);
+		bChanged = true;
+	}
 
-	return true;
+	if (bChanged)
+		clientInfo.PublishSnapshot();
 }
 
-bool MultiAddonManager::RemoveAddon(const char *pszAddon, bool bRefresh)
+void MultiAddonManager::PersistDownload(uint64 steamID64, PublishedFileId_t addon)
 {
-	int index = m_ExtraAddons.Find(pszAddon);
-
-	if (index == -1)
-	{
-		Panic("Addon %s is not in the list!\n", pszAddon);
-		return false;
-	}
-
-	Message("Removing %s from addon list\n", pszAddon);
-
-	m_ExtraAddons.Remove(index);
+	if (!(mm_cache_clients_with_addons.Get() || g_ClientDownloadCache.IsShared()) || !CAddonRegistry::IsWorkshopAddon(addon))
+		return;
 
-	// Update the convar to reflect the new addon list, but don't trigger the callback
-	mm_extra_addons.GetConVarData()->Value(0)->m_StringValue = VectorToString(m_ExtraAddons).c_str();
+	AddonInstallStamp_t stamp = GetAddonInstallStamp(addon);
 
-	if (bRefresh)
-		RefreshAddons();
+	if (stamp.m_nTimeUpdated)
+		g_ClientDownloadCache.Set(steamID64, addon, stamp.m_nTimeUpdated, (uint32)time(nullptr));
+}
 
-	return true;
+bool MultiAddonManager::HasUGCConnection()
+{
+	return g_pWorkshopBackend->IsAvailable();
 }
 
-CNetMessagePB<CNETMsg_SignonState> *GetAddonSignonStateMessage(const char *pszAddon)
+// Tell a connected client to reconnect for their next missing addon
+static void SendAddonReload(CServerSideClient *pClient, uint64 steamID64, CNetMessagePB<CNETMsg_SignonState> *pMsg)
 {
-	if (!gpGlobals)
-		return nullptr;
+	// Client is already loading, telling them to reload now will actually just disconnect them. ("Received signon %i when at %i\n" in client console)
+	if (pClient->GetSignonState() == SIGNONSTATE_CHANGELEVEL)
+		return;
 
-	INetworkMessageInternal *pNetMsg = g_pNetworkMessages->FindNetworkMessagePartial("SignonState");
-	CNetMessagePB<CNETMsg_SignonState> *pMsg = pNetMsg->AllocateMessage()->ToPB<CNETMsg_SignonState>();
-	pMsg->set_spawn_count(gpGlobals->serverCount);
-	pMsg->set_signon_state(SIGNONSTATE_CHANGELEVEL);
-	pMsg->set_addons(pszAddon ? pszAddon : "");
-	pMsg->set_num_server_players(GetClientList()->Count());
-	for (int i = 0; i < GetClientList()->Count(); i++)
-	{
-		auto client = GetClientList()->Element(i);
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.FindOrCreate(steamID64);
+	// Client still has addons to load anyway, they don't need to be told to reload
+	if (!pClientInfo || pClientInfo->currentPendingAddon)
+		return;
 
-		char const *szNetworkId = g_pEngineServer->GetPlayerNetworkIDString(client->GetPlayerSlot());
+	const CAddonList &addons = g_MultiAddonManager.GetClientAddons(steamID64);
 
-		pMsg->add_players_networkids(szNetworkId);
-	}
+	PublishedFileId_t nextAddon = addons.FindFirstMissing(pClientInfo->downloadedAddons);
 
-	return pMsg;
-}
+	if (!nextAddon)
+		return;
 
-bool MultiAddonManager::HasUGCConnection()
-{
-	return GetSteamUGC() != nullptr;
+	pClientInfo->currentPendingAddon = nextAddon;
+
+	pClient->GetNetChannel()->SendNetMessage(pMsg, BUF_RELIABLE);
 }
 
 void MultiAddonManager::AddClientAddon(const char *pszAddon, uint64 steamID64, bool bRefresh)
 {
+	PublishedFileId_t addon = g_AddonRegistry.Intern(pszAddon);
+
+	if (!addon)
+	{
+		Panic("Addon %s is invalid!\n", pszAddon);
+		return;
+	}
+
 	if (!steamID64)
 	{
-		if (m_GlobalClientAddons.Find(pszAddon) != -1)
+		if (!m_GlobalClientAddons.AddToTail(addon))
 		{
 			Panic("Addon %s is already in the list!\n", pszAddon);
 			return;
 		}
 	
-		m_GlobalClientAddons.AddToTail(pszAddon);
-		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = VectorToString(m_GlobalClientAddons).c_str();	
+		BumpAddonGeneration();
+		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = m_GlobalClientAddons.ToString().c_str();	
 	}
 	else
 	{
-		if (g_ClientAddons[steamID64].addonsToLoad.Find(pszAddon) != -1)
+		ClientAddonInfo_t *pClientInfo = g_ClientAddons.FindOrCreate(steamID64);
+
+		if (!pClientInfo->addonsToLoad.AddToTail(addon))
 		{
 			Panic("Addon %s is already in the list!\n", pszAddon);
 			return;
 		}
 
-		ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
-		clientInfo.addonsToLoad.AddToTail(pszAddon);
+		pClientInfo->addonListGeneration = 0;
+		pClientInfo->PublishSnapshot();
+		g_ClientAddons.Touch(pClientInfo);
 	}
 	
 	if (bRefresh)
 	{
-		CUtlVector<CServerSideClient*> &clients = *GetClientList();
 		auto pMsg = GetAddonSignonStateMessage(pszAddon);
 		if (!pMsg)
 		{
 			Panic("Failed to create signon state message for %s\n", pszAddon);
 			return;
 		}
-		FOR_EACH_VEC(clients, i)
+
+		if (steamID64)
+		{
+			if (CServerSideClient *pClient = g_ClientIndex.FindClient(steamID64))
+				SendAddonReload(pClient, steamID64, pMsg);
+		}
+		else
 		{
-			CServerSideClient *pClient = clients[i];
-			if (steamID64 == 0 || pClient->GetClientSteamID().ConvertToUint64() == steamID64)
-			{
-				// Client is already loading, telling them to reload now will actually just disconnect them. ("Received signon %i when at %i\n" in client console)
-				if (pClient->GetSignonState() == SIGNONSTATE_CHANGELEVEL)
-					break;
-				// Client still has addons to load anyway, they don't need to be told to reload
-				if (!g_ClientAddons[steamID64].currentPendingAddon.empty())
-					break;
-				ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
-
-				CUtlVector<std::string> addons;
-				g_MultiAddonManager.GetClientAddons(addons, steamID64);
-				
-				FOR_EACH_VEC(clientInfo.downloadedAddons, j)
-				{
-					addons.FindAndRemove(clientInfo.downloadedAddons[j]);
-				}
-
-				if (!addons.Count())
-				{
-					break;
-				}
-				clientInfo.currentPendingAddon = addons.Head();
-				
-				pClient->GetNetChannel()->SendNetMessage(pMsg, BUF_RELIABLE);
-
-				if (steamID64)
-				{
-					break;
-				}
-			}
+			g_ClientIndex.ForEach([pMsg](uint64 clientSteamID64, CServerSideClient *pClient) { SendAddonReload(pClient, clientSteamID64, pMsg); });
 		}
+
 		delete pMsg;
 	}
 }
 
 void MultiAddonManager::RemoveClientAddon(const char *pszAddon, uint64 steamID64)
 {
+	PublishedFileId_t addon = g_AddonRegistry.Find(pszAddon);
+
 	if (!steamID64)
 	{
-		m_GlobalClientAddons.FindAndRemove(pszAddon);
-		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = VectorToString(m_GlobalClientAddons).c_str();	
+		if (m_GlobalClientAddons.Remove(addon))
+			BumpAddonGeneration();
+		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = m_GlobalClientAddons.ToString().c_str();	
 	}
 	else
 	{
-		ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
-		clientInfo.addonsToLoad.FindAndRemove(pszAddon);
+		if (ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64))
+		{
+			if (pClientInfo->addonsToLoad.Remove(addon))
+			{
+				pClientInfo->addonListGeneration = 0;
+				pClientInfo->PublishSnapshot();
+			}
+		}
 	}
 }
 
@@ -864,38 +1624,81 @@ void MultiAddonManager::ClearClientAddons(uint64 steamID64)
 	if (!steamID64)
 	{
 		m_GlobalClientAddons.RemoveAll();
-		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = VectorToString(m_GlobalClientAddons).c_str();	
+		BumpAddonGeneration();
+		mm_client_extra_addons.GetConVarData()->Value(0)->m_StringValue = m_GlobalClientAddons.ToString().c_str();	
 	}
 	else
 	{
-		ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
-		clientInfo.addonsToLoad.RemoveAll();
+		if (ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64))
+		{
+			pClientInfo->addonsToLoad.RemoveAll();
+			pClientInfo->addonListGeneration = 0;
+			pClientInfo->PublishSnapshot();
+		}
 	}
 }
 
-void MultiAddonManager::GetClientAddons(CUtlVector<std::string> &addons, uint64 steamID64)
+const AddonConfig_t *MultiAddonManager::GetAddonConfig()
 {
-	addons.RemoveAll();
-	
-	if (!GetCurrentWorkshopMap().empty())
-		addons.AddToTail(GetCurrentWorkshopMap().c_str());
+	const AddonConfig_t *pConfig = m_AddonConfig.Get();
+
+	if (pConfig && pConfig->m_iGeneration == m_iAddonGeneration)
+		return pConfig;
+
+	AddonConfig_t *pNewConfig = new AddonConfig_t;
+	pNewConfig->m_iGeneration = m_iAddonGeneration;
+	pNewConfig->m_SharedClientAddons.AddListToTail(m_WorkshopMapAddons);
 	// The list of mounted addons should never contain the workshop map.
-	addons.AddVectorToTail(m_MountedAddons);
-	// Also make sure we don't have duplicates.
-	FOR_EACH_VEC(m_GlobalClientAddons, i)
-	{
-		if (addons.Find(m_GlobalClientAddons[i].c_str()) == -1)
-			addons.AddToTail(m_GlobalClientAddons[i].c_str());
-	}
+	pNewConfig->m_SharedClientAddons.AddListToTail(m_MountedAddons);
+	// CAddonList takes care of duplicates.
+	pNewConfig->m_SharedClientAddons.AddListToTail(m_GlobalClientAddons);
+	pNewConfig->m_sSharedClientAddons = pNewConfig->m_SharedClientAddons.ToString();
+
+	m_AddonConfig.Publish(pNewConfig);
+
+	return pNewConfig;
+}
+
+// Rebuilds the cached addon list of a client on top of the given configuration if it's stale, main thread only
+static void UpdateClientAddonList(const AddonConfig_t *pConfig, ClientAddonInfo_t &clientInfo)
+{
+	if (clientInfo.addonsToLoad.IsEmpty() || clientInfo.addonListGeneration == pConfig->m_iGeneration)
+		return;
+
+	clientInfo.addonList = pConfig->m_SharedClientAddons;
+	clientInfo.addonList.AddListToTail(clientInfo.addonsToLoad);
+	clientInfo.addonListString = clientInfo.addonList.ToString();
+	clientInfo.addonListGeneration = pConfig->m_iGeneration;
+
+	// The cached list usually makes up most of the entry size
+	g_ClientAddons.Touch(&clientInfo);
+}
+
+const CAddonList &MultiAddonManager::GetClientAddons(uint64 steamID64)
+{
+	const AddonConfig_t *pConfig = GetAddonConfig();
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64);
+
 	// If we specify a client steamID64, check for the addons exclusive to this client as well.
-	if (steamID64)
-	{
-		FOR_EACH_VEC(g_ClientAddons[steamID64].addonsToLoad, i)
-		{
-			if (addons.Find(g_ClientAddons[steamID64].addonsToLoad[i].c_str()) == -1)
-				addons.AddToTail(g_ClientAddons[steamID64].addonsToLoad[i].c_str());
-		}
-	}
+	if (!pClientInfo || pClientInfo->addonsToLoad.IsEmpty())
+		return pConfig->m_SharedClientAddons;
+
+	UpdateClientAddonList(pConfig, *pClientInfo);
+
+	return pClientInfo->addonList;
+}
+
+const std::string &MultiAddonManager::GetClientAddonsString(uint64 steamID64)
+{
+	const AddonConfig_t *pConfig = GetAddonConfig();
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64);
+
+	if (!pClientInfo || pClientInfo->addonsToLoad.IsEmpty())
+		return pConfig->m_sSharedClientAddons;
+
+	UpdateClientAddonList(pConfig, *pClientInfo);
+
+	return pClientInfo->addonListString;
 }
 
 CON_COMMAND_F(mm_add_client_addon, "Add a workshop ID to the global client-only addon list", FCVAR_SPONLY)
@@ -951,6 +1754,11 @@ CON_COMMAND_F(mm_download_addon, "Download an addon manually", FCVAR_SPONLY)
 	g_MultiAddonManager.DownloadAddon(args[1], false, true);
 }
 
+CON_COMMAND_F(mm_download_status, "Print the progress, throughput and time left of all addon downloads", FCVAR_SPONLY)
+{
+	g_MultiAddonManager.PrintDownloadProgress(true);
+}
+
 CON_COMMAND_F(mm_print_searchpaths, "Print search paths", FCVAR_SPONLY)
 {
 	g_pFullFileSystem->PrintSearchPaths();
@@ -968,6 +1776,9 @@ void MultiAddonManager::Hook_StartupServer(const GameSessionConfiguration_t &con
 
 	m_TimedOutClients.clear();
 
+	// The map is changing anyway, whatever was waiting for a reload gets applied now
+	m_flReloadTime = 0.0;
+
 	// Remove empty paths added when there are 2+ addons, they screw up file writes
 	g_pFullFileSystem->RemoveSearchPath("", "GAME");
 	g_pFullFileSystem->RemoveSearchPath("", "DEFAULT_WRITE_PATH");
@@ -975,66 +1786,111 @@ void MultiAddonManager::Hook_StartupServer(const GameSessionConfiguration_t &con
 	// This has to be done here to replicate the behavior on clients, where they mount addons in the string order
 	// So if the current map is ID 1 and extra addons are IDs 2 and 3, they would be mounted in that order with ID 3 at the top
 	// Note that the actual map VPK(s) and any sub-maps like team_select will be even higher, but those usually don't contain any assets that concern us
+	// Unless the workshop map changed, only the addons that differ from the last map are remounted
 	RefreshAddons();
+
+	m_MapStartAddons = m_MountedAddons;
+	m_bMountedAddonUpdated = false;
 }
 
 bool FASTCALL Hook_SendNetMessage(CServerSideClientBase *pClient, CNetMessage *pData, NetChannelBufType_t bufType, SendNetMessage_t pOriginalFunc)
 {
 	NetMessageInfo_t *info = pData->GetNetMessage()->GetNetMessageInfo();
-	
-	uint64 steamID64 = pClient->GetClientSteamID().ConvertToUint64();
-	ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
-	
+
+	// This runs for every message sent to every client, keep it to a compare and a store unless it's a signon message.
 	// If we are sending a message to the client, that means the client is still active.
-	clientInfo.lastActiveTime = Plat_FloatTime();
+	if (info->m_MessageId != net_SignonState || !g_bDedicatedServer)
+	{
+		g_ClientIndex.SetLastActiveTime(pClient->GetPlayerSlot(), g_flFrameTime.load(std::memory_order_relaxed));
+		return pOriginalFunc(pClient, pData, bufType);
+	}
+
+	// This can run on a network thread, so only read the client entry, published addon configuration and registry inside this scope
+	CRcuReadScope rcuScope;
 
-	if (info->m_MessageId != net_SignonState || !g_pEngineServer->IsDedicatedServer())
+	uint64 steamID64 = pClient->GetClientSteamID().ConvertToUint64();
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64);
+
+	// Clients we never replied to (e.g. bots) have nothing to download
+	if (!pClientInfo)
 		return pOriginalFunc(pClient, pData, bufType);
 
+	ClientAddonInfo_t &clientInfo = *pClientInfo;
+
+	// Signon messages are rare and the addon timeouts are measured from them, so use the precise time here
+	double flTime = Plat_FloatTime();
+	clientInfo.lastActiveTime = flTime;
+	g_ClientIndex.SetLastActiveTime(pClient->GetPlayerSlot(), flTime);
+
 	auto pMsg = pData->ToPB<CNETMsg_SignonState>();
 
-	CUtlVector<std::string> addons;
-	g_MultiAddonManager.GetClientAddons(addons, steamID64);
-	
-	
 	if (pMsg->signon_state() == SIGNONSTATE_CHANGELEVEL)
 	{
 		// When switching to another map, the signon message might contain more than 1 addon.
 		// This puts the client in limbo because client doesn't know how to handle multiple addons at the same time.
-		CUtlVector<std::string> addonsList;
-		StringToVector(pMsg->addons().c_str(), addonsList);
-		if (addonsList.Count() > 1)
+		const std::string &sAddons = pMsg->addons();
+		size_t nSeparator = sAddons.find(',');
+		if (nSeparator != std::string::npos)
 		{
 			// If there's more than one addon, ensure that it takes the first addon (which should be the workshop map or the first custom addon)
-			pMsg->set_addons(addonsList.Head());
+			std::string sFirstAddon = sAddons.substr(0, nSeparator);
 			// Since the client will download the addon contained inside this messsage, we might as well add it to the list of client's downloaded addons.
-			clientInfo.currentPendingAddon = addonsList.Head();
+			clientInfo.currentPendingAddon = g_AddonRegistry.Find(sFirstAddon.c_str());
+			pMsg->set_addons(sFirstAddon);
 		}
-		else if (addonsList.Count() == 1)
+		else if (!sAddons.empty())
 		{
 			// Nothing to do here, the rest of the required addons can be sent later.
-			clientInfo.currentPendingAddon = pMsg->addons();
+			clientInfo.currentPendingAddon = g_AddonRegistry.Find(sAddons.c_str());
 		}
 		
 		return pOriginalFunc(pClient, pData, bufType);
 	}
-	FOR_EACH_VEC(clientInfo.downloadedAddons, i)
+
+	// The client's load order is the shared addons followed by its own ones. Both are walked in place from published snapshots,
+	// and membership checks only look up existing registry slots, so this never locks, allocates or interns anything.
+	const AddonConfig_t *pConfig = g_MultiAddonManager.GetPublishedAddonConfig();
+	const CAddonList &sharedAddons = pConfig->m_SharedClientAddons;
+	const ClientAddonSnapshot_t *pSnapshot = clientInfo.snapshot.Get();
+
+	PublishedFileId_t nextAddon = 0;
+	int nPendingAddons = 0;
+
+	auto checkAddon = [&](PublishedFileId_t addon)
+	{
+		if (pSnapshot && pSnapshot->downloadedAddons.Has(addon))
+			return;
+
+		if (!nextAddon)
+			nextAddon = addon;
+
+		nPendingAddons++;
+	};
+
+	for (int i = 0; i < sharedAddons.Count(); i++)
+		checkAddon(sharedAddons[i]);
+
+	if (pSnapshot)
 	{
-		addons.FindAndRemove(clientInfo.downloadedAddons[i]);
+		for (int i = 0; i < pSnapshot->addonsToLoad.Count(); i++)
+		{
+			if (!sharedAddons.Has(pSnapshot->addonsToLoad[i]))
+				checkAddon(pSnapshot->addonsToLoad[i]);
+		}
 	}
-	
+
 	// Check if client has downloaded everything.
-	if (addons.Count() == 0)
+	if (!nPendingAddons)
 	{
 		return pOriginalFunc(pClient, pData, bufType);
 	}
 
 	if (mm_addon_debug.Get())
-		Message("%s: Number of addons remaining to download for %lli: %d\n", __func__, steamID64, addons.Count());
+		Message("%s: Number of addons remaining to download for %lli: %d\n", __func__, steamID64, nPendingAddons);
 
-	// Otherwise, send the next addon to the client.
-	clientInfo.currentPendingAddon = addons.Head();
-	pMsg->set_addons(addons.Head().c_str());
+	// Otherwise, send the next addon to the client, following the load order.
+	clientInfo.currentPendingAddon = nextAddon;
+	pMsg->set_addons(g_AddonRegistry.GetName(nextAddon));
 	pMsg->set_signon_state(SIGNONSTATE_CHANGELEVEL);
 
 	return pOriginalFunc(pClient, pData, bufType);
@@ -1091,53 +1947,62 @@ void FASTCALL Hook_SetPendingHostStateRequest(CHostStateMgr* pMgrDoNotUse, CHost
 	if (g_MultiAddonManager.m_ExtraAddons.Count() == 0)
 		return g_pfnSetPendingHostStateRequest(pMgrDoNotUse, pRequest);
 
-	// Rebuild the addon list. We always start with the original addon.
-	if (g_MultiAddonManager.GetCurrentWorkshopMap().empty())
-	{
-		pRequest->m_Addons = VectorToString(g_MultiAddonManager.m_ExtraAddons).c_str();
-	}
-	else
-	{
-		// Don't add the same addon twice. Hopefully no server owner is diabolical enough to do things like `map de_dust2 customgamemode=1234,5678`.
-		CUtlVector<std::string> newAddons;
-		newAddons.CopyArray(g_MultiAddonManager.m_ExtraAddons.Base(), g_MultiAddonManager.m_ExtraAddons.Count());
-		newAddons.FindAndRemove(g_MultiAddonManager.GetCurrentWorkshopMap().c_str());
-		newAddons.AddToHead(g_MultiAddonManager.GetCurrentWorkshopMap().c_str());
-		pRequest->m_Addons = VectorToString(newAddons).c_str();
-	}
+	// Rebuild the addon list. We always start with the original addon(s), and don't add the same addon twice.
+	const CAddonList &workshopMapAddons = g_MultiAddonManager.GetCurrentWorkshopMapAddons();
+	CAddonList newAddons;
+
+	for (int i = 0; i < workshopMapAddons.Count(); i++)
+		newAddons.AddToTail(workshopMapAddons[i]);
+
+	for (int i = 0; i < g_MultiAddonManager.m_ExtraAddons.Count(); i++)
+		newAddons.AddToTail(g_MultiAddonManager.m_ExtraAddons[i]);
+
+	pRequest->m_Addons = newAddons.ToString().c_str();
 
 	g_pfnSetPendingHostStateRequest(pMgrDoNotUse, pRequest);
 }
 
-void MultiAddonManager::CheckClientAddons(uint64 steamID64)
+void MultiAddonManager::CheckClientAddons(uint64 steamID64, CPlayerSlot slot)
 {
-	ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
+	// Clients only get an entry once we reply to their connection, bots and HLTV never do
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64);
+	if (!pClientInfo)
+		return;
+
+	g_ClientAddons.Touch(pClientInfo);
+
+	ClientAddonInfo_t &clientInfo = *pClientInfo;
 	clientInfo.connectedState = CLIENTCONN_JOINED;
 
-	CUtlVector<std::string> addons;
-	GetClientAddons(addons, steamID64);
+	const CAddonList &addons = GetClientAddons(steamID64);
 	// We don't have an extra addon set so do nothing here, also don't do anything if we're a listenserver
-	if (addons.Count() == 0 || !g_pEngineServer->IsDedicatedServer())
+	if (addons.Count() == 0 || !g_bDedicatedServer)
 		return;
 
-	if (!clientInfo.currentPendingAddon.empty())
+	if (clientInfo.currentPendingAddon)
 	{
-		if (Plat_FloatTime() - clientInfo.lastActiveTime > mm_extra_addons_timeout.Get())
+		// Regular messages only update the slot, if the client is reconnecting in the same slot they count as activity too
+		double flLastActiveTime = std::max(clientInfo.lastActiveTime.load(), g_ClientIndex.GetLastActiveTime(slot));
+
+		if (Plat_FloatTime() - flLastActiveTime > mm_extra_addons_timeout.Get())
 		{
 			if (mm_addon_debug.Get())
 				Message("%s: Client %lli has reconnected after the timeout or did not receive the addon message, will not add addon %s to the downloaded list\n",
-					__func__, steamID64, clientInfo.currentPendingAddon.c_str());
+					__func__, steamID64, g_AddonRegistry.GetName(clientInfo.currentPendingAddon));
 		}
 		else
 		{
 			if (mm_addon_debug.Get())
 				Message("%s: Client %lli has connected within the interval with the pending addon %s, will send next addon in SendNetMessage hook\n",
-					__func__, steamID64, clientInfo.currentPendingAddon.c_str());
+					__func__, steamID64, g_AddonRegistry.GetName(clientInfo.currentPendingAddon));
+
+			clientInfo.MarkDownloaded(clientInfo.currentPendingAddon, GetAddonInstallStamp(clientInfo.currentPendingAddon));
+			clientInfo.PublishSnapshot();
 
-			clientInfo.downloadedAddons.AddToTail(clientInfo.currentPendingAddon);
+			PersistDownload(steamID64, clientInfo.currentPendingAddon);
 		}
 		// Reset the current pending addon anyway, SendNetMessage tells us which addon to download next.
-		clientInfo.currentPendingAddon.clear();
+		clientInfo.currentPendingAddon = 0;
 	}
 	clientInfo.lastActiveTime = Plat_FloatTime();
 	return;
@@ -1145,57 +2010,107 @@ void MultiAddonManager::CheckClientAddons(uint64 steamID64)
 
 bool MultiAddonManager::Hook_ClientConnect( CPlayerSlot slot, const char *pszName, uint64 steamID64, const char *pszNetworkID, bool unk1, CBufferString *pRejectReason )
 {
-	CheckClientAddons(steamID64);
+	CheckClientAddons(steamID64, slot);
+	g_ClientIndex.Set(slot, steamID64, nullptr);
 	RETURN_META_VALUE(MRES_IGNORED, true);
 }
 
 bool MultiAddonManager::Hook_CanHLTVClientConnect(int index, const CSteamID &steamID, int *pRejectReason)
 {
-	CheckClientAddons(steamID.ConvertToUint64());
+	CheckClientAddons(steamID.ConvertToUint64(), CPlayerSlot(-1));
 	RETURN_META_VALUE(MRES_IGNORED, true);
 }
 
 void MultiAddonManager::Hook_ClientDisconnect( CPlayerSlot slot, ENetworkDisconnectionReason reason, const char *pszName, uint64 steamID64, const char *pszNetworkID )
 {
+	// The slot will be reused by someone else
+	g_ClientIndex.Clear(slot);
+
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64);
+	if (!pClientInfo)
+		return;
+
 	// Mark the disconnection time for caching purposes.
-	g_ClientAddons[steamID64].lastActiveTime = Plat_FloatTime();
-	g_ClientAddons[steamID64].connectedState = CLIENTCONN_NONE;
+	pClientInfo->lastActiveTime = Plat_FloatTime();
+	pClientInfo->connectedState = CLIENTCONN_NONE;
+	g_ClientAddons.Touch(pClientInfo);
 }
 
 void MultiAddonManager::Hook_ClientActive(CPlayerSlot slot, bool bLoadGame, const char * pszName, uint64 steamID64)
 {
 	// When the client reaches this stage, they should already have all the necessary addons downloaded, so we can safely remove the downloaded addons list here.
-	if (!mm_cache_clients_with_addons.Get())
-		g_ClientAddons[steamID64].downloadedAddons.RemoveAll();
+	if (mm_cache_clients_with_addons.Get())
+		return;
+
+	if (ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64))
+	{
+		pClientInfo->ClearDownloads();
+		pClientInfo->PublishSnapshot();
+	}
+}
+
+// Evicts clients past the cache budget and expires the ones gone for longer than the cache lifetime.
+// Only a few entries from the cold end are looked at per frame, so this never causes a hitch no matter how big the cache is.
+void MultiAddonManager::SweepClientCache()
+{
+	constexpr int iMaxStepsPerFrame = 16;
+
+	// Without caching, the download state is still needed while clients reconnect to get their addons, and they don't have a slot while downloading.
+	// So only expire it if asked to and leave the rest to the budget.
+	double flLifetime = mm_cache_clients_with_addons.Get() ? mm_cache_clients_duration.Get() : mm_cache_clients_uncached_duration.Get();
+
+	double flExpireTime = flLifetime > 0 ? Plat_FloatTime() - flLifetime : -1.0;
+
+	g_ClientAddons.Sweep(flExpireTime, mm_cache_clients_max_entries.Get(), (size_t)std::max(mm_cache_clients_max_kb.Get(), 0) * 1024, iMaxStepsPerFrame,
+		[](uint64 steamID64) { return g_ClientIndex.FindClient(steamID64) != nullptr; });
 }
 
 void MultiAddonManager::Hook_GameFrame(bool simulating, bool bFirstTick, bool bLastTick)
 {
 	static double s_flTime = 0.0f;
 
-	// Print download progress every second
+	g_flFrameTime.store(Plat_FloatTime(), std::memory_order_relaxed);
+
+	// Publish any addon configuration change for the network thread hooks, and free the snapshots they're done with
+	GetAddonConfig();
+	g_Rcu.Reclaim();
+
+	SweepClientCache();
+	UpdatePendingReload();
+
+	// Check on downloads every second
 	if (Plat_FloatTime() - s_flTime > 1.f)
 	{
 		s_flTime = Plat_FloatTime();
-		PrintDownloadProgress();
+		UpdateDownloadProgress();
+		PrintDownloadProgress(false);
+
+		CheckStalledDownloads();
+
+		// Retries that are due
+		StartQueuedDownloads();
+		g_ClientDownloadCache.Flush();
 	}
 
 	if (!m_TimedOutClients.size())
 		return;
 
-	auto pClients = GetClientList();
-
-	FOR_EACH_VEC(*pClients, i)
+	for (auto it = m_TimedOutClients.begin(); it != m_TimedOutClients.end();)
 	{
-		auto pClient = (*pClients)[i];
-
-		uint64 steamID64 = pClient->GetClientSteamID().ConvertToUint64();
+		uint64 steamID64 = *it;
+		CServerSideClient *pClient = g_ClientIndex.FindClient(steamID64);
 
-		if (m_TimedOutClients.erase(steamID64))
+		if (!pClient)
 		{
-			pClient->Disconnect(NETWORK_DISCONNECT_TIMEDOUT, "Required Workshop addon download was not accepted in time");
-			g_ClientAddons[steamID64].connectedState = CLIENTCONN_NONE;
+			it++;
+			continue;
 		}
+
+		it = m_TimedOutClients.erase(it);
+
+		pClient->Disconnect(NETWORK_DISCONNECT_TIMEDOUT, "Required Workshop addon download was not accepted in time");
+		if (ClientAddonInfo_t *pClientInfo = g_ClientAddons.Find(steamID64))
+			pClientInfo->connectedState = CLIENTCONN_NONE;
 	}
 }
 
@@ -1235,15 +2150,29 @@ int MultiAddonManager::Hook_LoadEventsFromFile(const char *filename, bool bSearc
 void FASTCALL Hook_ReplyConnection(INetworkGameServer *server, CServerSideClient *client)
 {
 	uint64 steamID64 = client->GetClientSteamID().ConvertToUint64();
+
+	// Whatever was sent in this slot before was for another connection
+	g_ClientIndex.Set(client->GetPlayerSlot(), steamID64, client);
+
+	ClientAddonInfo_t *pClientInfo = g_ClientAddons.FindOrCreate(steamID64);
+	if (!pClientInfo)
+	{
+		g_pfnReplyConnection(server, client);
+		return;
+	}
+
+	g_ClientAddons.Touch(pClientInfo);
+
 	// Clear cache if necessary.
-	ClientAddonInfo_t &clientInfo = g_ClientAddons[steamID64];
+	ClientAddonInfo_t &clientInfo = *pClientInfo;
 	if (mm_cache_clients_with_addons.Get() && mm_cache_clients_duration.Get() != 0 && Plat_FloatTime() - clientInfo.lastActiveTime > mm_cache_clients_duration.Get())
 	{
 		if (mm_addon_debug.Get())
 			Message("%s: Client %lli has not connected for a while, clearing the cache\n", __func__, steamID64);
 
-		clientInfo.currentPendingAddon.clear();
-		clientInfo.downloadedAddons.RemoveAll();
+		clientInfo.currentPendingAddon = 0;
+		clientInfo.ClearDownloads();
+		clientInfo.PublishSnapshot();
 	}
 	clientInfo.lastActiveTime = Plat_FloatTime();
 
@@ -1252,17 +2181,18 @@ void FASTCALL Hook_ReplyConnection(INetworkGameServer *server, CServerSideClient
 	CUtlString originalAddons = *addons;
 
 	// Figure out which addons the client should be loading.
-	CUtlVector<std::string> clientAddons;
-	g_MultiAddonManager.GetClientAddons(clientAddons, steamID64);
+	const CAddonList &clientAddons = g_MultiAddonManager.GetClientAddons(steamID64);
 	if (clientAddons.Count() == 0)
 	{
 		// No addons to send. This means the list of original addons is empty as well.
 		assert(originalAddons.IsEmpty());
-		clientInfo.currentPendingAddon.clear();
+		clientInfo.currentPendingAddon = 0;
 		g_pfnReplyConnection(server, client);
 		return;
 	}
 
+	LoadPersistedDownloads(steamID64, clientInfo, clientAddons);
+
 	if (clientInfo.connectedState != CLIENTCONN_CONNECTING)
 	{
 		clientInfo.connectionStartTime = Plat_FloatTime();
@@ -1278,20 +2208,31 @@ void FASTCALL Hook_ReplyConnection(INetworkGameServer *server, CServerSideClient
 	}
 
 	// Handle the first addon here. The rest should be handled in the SendNetMessage hook.
-	if (clientInfo.downloadedAddons.Find(clientAddons[0]) == -1)
+	if (!clientInfo.downloadedAddons.Has(clientAddons[0]))
 		clientInfo.currentPendingAddon = clientAddons[0];
 
 	// In some cases, clients can do a signature check on addons which fails and instantly disconnects them
 	// As a mitigation, remove all undownloaded addons so the client never does the failing signature check
-	FOR_EACH_VEC_BACK(clientAddons, i)
+	CAddonBitSet missingAddons = clientAddons.GetSet();
+	missingAddons.AndNot(clientInfo.downloadedAddons);
+	missingAddons.Remove(clientInfo.currentPendingAddon);
+
+	if (missingAddons.IsEmpty())
 	{
-		if (clientInfo.downloadedAddons.Find(clientAddons[i]) != -1 || clientAddons[i] == clientInfo.currentPendingAddon)
-			continue;
+		// Client has everything already, the cached string can be sent as is
+		*addons = g_MultiAddonManager.GetClientAddonsString(steamID64).c_str();
+	}
+	else
+	{
+		CAddonList sentAddons;
+		for (int i = 0; i < clientAddons.Count(); i++)
+		{
+			if (!missingAddons.Has(clientAddons[i]))
+				sentAddons.AddToTail(clientAddons[i]);
+		}
 
-		clientAddons.Remove(i);
+		*addons = sentAddons.ToString().c_str();
 	}
-	
-	*addons = VectorToString(clientAddons).c_str();
 
 	if (mm_addon_debug.Get())
 		Message("%s: Sending addons %s to steamID64 %lli\n", __func__, addons->Get(), steamID64);
@@ -1306,9 +2247,10 @@ uint64 FASTCALL Hook_ScriptGetAddon()
 	if (!g_MultiAddonManager.m_ExtraAddons.Count())
 		return g_pfnScriptGetAddon();
 
-	uint64 iAddon = V_StringToUint64(g_MultiAddonManager.GetCurrentWorkshopMap().c_str(), 0);
+	const CAddonList &workshopMapAddons = g_MultiAddonManager.GetCurrentWorkshopMapAddons();
+	uint64 iAddon = workshopMapAddons.IsEmpty() ? 0 : workshopMapAddons.Head();
 	
-	if (!iAddon)
+	if (!CAddonRegistry::IsWorkshopAddon(iAddon))
 		return g_pfnScriptGetAddon();
 
 	return iAddon;
@@ -22,12 +22,14 @@
 #include <ISmmPlugin.h>
 #include <igameevents.h>
 #include <sh_vector.h>
-#include "utlqueue.h"
 #include "utlvector.h"
 #include "networksystem/inetworkserializer.h"
 #include "steam/steam_api_common.h"
 #include "steam/isteamugc.h"
 #include "imultiaddonmanager.h"
+#include "addonregistry.h"
+#include "clientaddontable.h"
+#include "downloadscheduler.h"
 
 #ifdef _WIN32
 #define ROOTBIN "/bin/win64/"
@@ -37,6 +39,30 @@
 #define GAMEBIN "/csgo/bin/linuxsteamrt64/"
 #endif
 
+// Immutable snapshot of the addon configuration shared by all clients, republished whenever the addon generation changes.
+// Hooks that can run off the main thread read it inside a CRcuReadScope, so they never see a list half-updated.
+struct AddonConfig_t
+{
+	uint32 m_iGeneration;
+
+	// Workshop map, mounted addons then global client addons, in the order clients load them
+	CAddonList m_SharedClientAddons;
+	std::string m_sSharedClientAddons;
+};
+
+// Where and how a workshop addon is installed. Resolved on first use and kept until the addon is downloaded again,
+// so mounting the same addons over and over doesn't keep asking Steam and the filesystem the same questions.
+struct ResolvedAddon_t
+{
+	bool m_bResolved = false;
+	bool m_bFound = false; // Installed and the VPK exists
+	bool m_bLegacy = false; // A single VPK from before multi-chunk addons, otherwise a _dir VPK with numbered chunks
+	int m_nChunks = 0;
+	uint32 m_nItemState = 0; // EItemState flags
+	std::string m_sPath; // The VPK path to mount, without _dir as the filesystem appends suffixes itself
+	AddonInstallStamp_t m_Stamp;
+};
+
 class MultiAddonManager : public ISmmPlugin, public IMetamodListener, public IMultiAddonManager
 {
 public:
@@ -55,28 +81,58 @@ public: //hooks
 	int Hook_LoadEventsFromFile(const char *filename, bool bSearchAll);
 	bool Hook_CanHLTVClientConnect(int index, const CSteamID &steamID, int *pRejectReason);
 
-	void BuildAddonPath(const char *pszAddon, char *buf, size_t len, bool bLegacy);
-	bool MountAddon(const char *pszAddon, bool bAddToTail);
-	bool UnmountAddon(const char *pszAddon);
+	void BuildAddonPath(PublishedFileId_t addon, char *buf, size_t len, bool bLegacy);
+	bool MountAddon(PublishedFileId_t addon, bool bAddToTail);
+	bool UnmountAddon(PublishedFileId_t addon);
 	bool AddAddon(const char *pszAddon, bool bRefresh = false);
 	bool RemoveAddon(const char *pszAddon, bool bRefresh = false);
-	bool IsAddonMounted(const char *pszAddon, bool bCheckWorkshopMap = false) { return m_MountedAddons.Find(pszAddon) != -1 || (bCheckWorkshopMap && GetCurrentWorkshopMap() == pszAddon);  }
+	bool IsAddonMounted(const char *pszAddon, bool bCheckWorkshopMap = false);
 	bool DownloadAddon(const char *pszAddon, bool bImportant = false, bool bForce = false);
-	void PrintDownloadProgress();
-	void RefreshAddons(bool bReloadMap = false);
+	bool DownloadAddon(PublishedFileId_t addon, bool bImportant = false, bool bForce = false);
+	void UpdateDownloadProgress();
+	void PrintDownloadProgress(bool bVerbose);
+	bool GetDownloadProgress(AddonDownloadProgress_t *pProgress);
+	void StartQueuedDownloads();
+	void CheckStalledDownloads();
+	bool RetryDownload(PublishedFileId_t addon);
+	void OnDownloadFinished(const DownloadItem_t &item);
+	void RefreshAddons(bool bReloadMap = false, bool bRemountAll = false);
+	void VerifyMountOrder();
 	void ClearAddons();
 	void ReloadMap();
-	std::string GetCurrentWorkshopMap() { return m_sCurrentWorkshopMap; }
-	void SetCurrentWorkshopMap(const char *pszWorkshopID) { m_sCurrentWorkshopMap = pszWorkshopID; }
-	void ClearCurrentWorkshopMap() { m_sCurrentWorkshopMap.clear(); }
+	void RequestMapReload();
+	void UpdatePendingReload();
+	const std::string &GetCurrentWorkshopMap() { return m_sCurrentWorkshopMap; }
+	const CAddonList &GetCurrentWorkshopMapAddons() { return m_WorkshopMapAddons; }
+	void SetCurrentWorkshopMap(const char *pszWorkshopID);
+	void ClearCurrentWorkshopMap();
 
 	bool HasUGCConnection();
 	void AddClientAddon(const char *pszAddon, uint64 steamID64 = 0, bool bRefresh = false);
 	void RemoveClientAddon(const char *pszAddon, uint64 steamID64 = 0);
 	void ClearClientAddons(uint64 steamID64 = 0);
-	void GetClientAddons(CUtlVector<std::string> &addons, uint64 steamID64 = 0);
-	void CheckClientAddons(uint64 steamID64);
+	// Returns the ordered list of addons a client should load, pass 0 to only get the addons shared by all clients
+	const CAddonList &GetClientAddons(uint64 steamID64 = 0);
+	const std::string &GetClientAddonsString(uint64 steamID64 = 0);
+	// Must be called whenever the workshop map, mounted addons or global client addons change
+	void BumpAddonGeneration() { m_iAddonGeneration++; }
+	// Main thread only, publishes a new snapshot first if the configuration changed
+	const AddonConfig_t *GetAddonConfig();
+	// Any thread, must be used inside a CRcuReadScope when not on the main thread
+	const AddonConfig_t *GetPublishedAddonConfig() { return m_AddonConfig.Get(); }
+	void CheckClientAddons(uint64 steamID64, CPlayerSlot slot);
 	void AddTimedOutClient(uint64 steamID64) { m_TimedOutClients.insert(steamID64); }
+	void SweepClientCache();
+	void OpenClientDownloadCache();
+	void SaveMountManifest();
+	void CheckForUpdates();
+	void MountFromManifest();
+	const ResolvedAddon_t *ResolveAddon(PublishedFileId_t addon);
+	void ForgetResolvedAddon(PublishedFileId_t addon);
+	AddonInstallStamp_t GetAddonInstallStamp(PublishedFileId_t addon);
+	void InvalidateStaleDownloads(PublishedFileId_t addon);
+	void LoadPersistedDownloads(uint64 steamID64, ClientAddonInfo_t &clientInfo, const CAddonList &addons);
+	void PersistDownload(uint64 steamID64, PublishedFileId_t addon);
 
 public:
 	const char *GetAuthor() override		{ return "xen"; }
@@ -88,158 +144,204 @@ public:
 	const char *GetDate() override			{ return __DATE__; }
 	const char *GetLogTag() override		{ return "MultiAddonManager"; }
 
-	CUtlVector<std::string> m_ExtraAddons;
+	CAddonList m_ExtraAddons;
 
 	// List of addons mounted by the plugin. Does not contain the original server mounted addon.
-	CUtlVector<std::string> m_MountedAddons;
+	CAddonList m_MountedAddons;
+
+	// What m_MountedAddons was when the current map started, in the same order
+	CAddonList m_MapStartAddons;
+	// Whether a mounted addon got a new version since then
+	bool m_bMountedAddonUpdated = false;
+	// The workshop map m_MountedAddons were mounted under, they're all remounted when it changes
+	std::string m_sMountedWorkshopMap;
+
+	// Addons mounted from the manifest before Steam was up, still to be checked against what Steam has installed
+	CAddonList m_ManifestAddons;
 	
 	// List of addons to be mounted by the all clients.
-	CUtlVector<std::string> m_GlobalClientAddons;
+	CAddonList m_GlobalClientAddons;
 
 private:
-	CUtlVector<PublishedFileId_t> m_ImportantDownloads; // Important addon downloads that will trigger a map reload when finished
-	CUtlQueue<PublishedFileId_t> m_DownloadQueue; // Queue of all addon downloads to print progress
+	CDownloadScheduler m_Downloads; // All addon downloads we started or are about to, important ones trigger a map reload when finished
+	double m_flDownloadRate = 0.0; // Bytes per second, moving average
+	double m_flLastDownloadSample = 0.0;
+	double m_flNextProgressPrint = 0.0;
+
+	// When the pending map reload happens, 0 if there's none
+	double m_flReloadTime = 0.0;
+	double m_flFirstReloadRequest = 0.0;
 
 	STEAM_GAMESERVER_CALLBACK_MANUAL(MultiAddonManager, OnAddonDownloaded, DownloadItemResult_t, m_CallbackDownloadItemResult);
 	// Used when reloading current map
 	std::string m_sCurrentWorkshopMap;
+	// The same as above split into interned addons, the server can mount more than one with customgamemode
+	CAddonList m_WorkshopMapAddons;
 
 	std::set<uint64> m_TimedOutClients;
+
+	// Addon configuration generation, any cached client addon list older than this is stale
+	uint32 m_iAddonGeneration = 1;
+
+	CRcuPointer<AddonConfig_t> m_AddonConfig;
+
+	// Resolved workshop addons indexed by registry slot
+	std::vector<ResolvedAddon_t> m_ResolvedAddons;
+
+	// The workshop on a dedicated server is stored relative to the working directory, fetched on first use
+	std::string m_sWorkingDir;
 };
 
 extern MultiAddonManager g_MultiAddonManager;
 
 PLUGIN_GLOBALVARS();
 
-// Taken from the comments in steamclientpublic.h and https://partner.steamgames.com/doc/api/steam_api
-constexpr const char* g_SteamErrorMessages[] =
+struct SteamResultInfo_t
+{
+	const char *m_pszMessage;
+	bool m_bRetryable; // Worth trying again later, as opposed to something that will keep failing (bad ID, access denied, disk full, ...)
+};
+
+// Indexed by EResult. Messages taken from the comments in steamclientpublic.h and https://partner.steamgames.com/doc/api/steam_api
+constexpr SteamResultInfo_t g_SteamErrorMessages[] =
 {
-	"No result.",
-	"Success.",
-	"Generic failure.",
-	"Your Steam client doesn't have a connection to the back-end.",
-	"NoConnectionRetry: This should never appear unless Valve is trolling.",
-	"Password/ticket is invalid.",
-	"The user is logged in elsewhere.",
-	"Protocol version is incorrect.",
-	"A parameter is incorrect.",
-	"File was not found.",
-	"Called method is busy - action not taken.",
-	"Called object was in an invalid state.",
-	"The name was invalid.",
-	"The email was invalid.",
-	"The name is not unique.",
-	"Access is denied.",
-	"Operation timed out.",
-	"The user is VAC2 banned.",
-	"Account not found.",
-	"The Steam ID was invalid.",
-	"The requested service is currently unavailable.",
-	"The user is not logged on.",
-	"Request is pending, it may be in process or waiting on third party.",
-	"Encryption or Decryption failed.",
-	"Insufficient privilege.",
-	"Too much of a good thing.",
-	"Access has been revoked (used for revoked guest passes.)",
-	"License/Guest pass the user is trying to access is expired.",
-	"Guest pass has already been redeemed by account, cannot be used again.",
-	"The request is a duplicate and the action has already occurred in the past, ignored this time.",
-	"All the games in this guest pass redemption request are already owned by the user.",
-	"IP address not found.",
-	"Failed to write change to the data store.",
-	"Failed to acquire access lock for this operation.",
-	"The logon session has been replaced.",
-	"Failed to connect.",
-	"The authentication handshake has failed.",
-	"There has been a generic IO failure.",
-	"The remote server has disconnected.",
-	"Failed to find the shopping cart requested.",
-	"A user blocked the action.",
-	"The target is ignoring sender.",
-	"Nothing matching the request found.",
-	"The account is disabled.",
-	"This service is not accepting content changes right now.",
-	"Account doesn't have value, so this feature isn't available.",
-	"Allowed to take this action, but only because requester is admin.",
-	"A Version mismatch in content transmitted within the Steam protocol.",
-	"The current CM can't service the user making a request, user should try another.",
-	"You are already logged in elsewhere, this cached credential login has failed.",
-	"The user is logged in elsewhere. (Use instead!)",
-	"Long running operation has suspended/paused. (eg. content download.)",
-	"Operation has been canceled, typically by user. (eg. a content download.)",
-	"Operation canceled because data is ill formed or unrecoverable.",
-	"Operation canceled - not enough disk space.",
-	"The remote or IPC call has failed.",
-	"Password could not be verified as it's unset server side.",
-	"External account (PSN, Facebook...) is not linked to a Steam account.",
-	"PSN ticket was invalid.",
-	"External account (PSN, Facebook...) is already linked to some other account, must explicitly request to replace/delete the link first.",
-	"The sync cannot resume due to a conflict between the local and remote files.",
-	"The requested new password is not allowed.",
-	"New value is the same as the old one. This is used for secret question and answer.",
-	"Account login denied due to 2nd factor authentication failure.",
-	"The requested new password is not legal.",
-	"Account login denied due to auth code invalid.",
-	"Account login denied due to 2nd factor auth failure - and no mail has been sent.",
-	"The users hardware does not support Intel's Identity Protection Technology (IPT).",
-	"Intel's Identity Protection Technology (IPT) has failed to initialize.",
-	"Operation failed due to parental control restrictions for current user.",
-	"Facebook query returned an error.",
-	"Account login denied due to an expired auth code.",
-	"The login failed due to an IP restriction.",
-	"The current users account is currently locked for use. This is likely due to a hijacking and pending ownership verification.",
-	"The logon failed because the accounts email is not verified.",
-	"There is no URL matching the provided values.",
-	"Bad Response due to a Parse failure, missing field, etc.",
-	"The user cannot complete the action until they re-enter their password.",
-	"The value entered is outside the acceptable range.",
-	"Something happened that we didn't expect to ever happen.",
-	"The requested service has been configured to be unavailable.",
-	"The files submitted to the CEG server are not valid.",
-	"The device being used is not allowed to perform this action.",
-	"The action could not be complete because it is region restricted.",
-	"Temporary rate limit exceeded, try again later, different from which may be permanent.",
-	"Need two-factor code to login.",
-	"The thing we're trying to access has been deleted.",
-	"Login attempt failed, try to throttle response to possible attacker.",
-	"Two factor authentication (Steam Guard) code is incorrect.",
-	"The activation code for two-factor authentication (Steam Guard) didn't match.",
-	"The current account has been associated with multiple partners.",
-	"The data has not been modified.",
-	"The account does not have a mobile device associated with it.",
-	"The time presented is out of range or tolerance.",
-	"SMS code failure - no match, none pending, etc.",
-	"Too many accounts access this resource.",
-	"Too many changes to this account.",
-	"Too many changes to this phone.",
-	"Cannot refund to payment method, must use wallet.",
-	"Cannot send an email.",
-	"Can't perform operation until payment has settled.",
-	"The user needs to provide a valid captcha.",
-	"A game server login token owned by this token's owner has been banned.",
-	"Game server owner is denied for some other reason such as account locked, community ban, vac ban, missing phone, etc.",
-	"The type of thing we were requested to act on is invalid.",
-	"The IP address has been banned from taking this action.",
-	"This Game Server Login Token (GSLT) has expired from disuse; it can be reset for use.",
-	"User doesn't have enough wallet funds to complete the action.",
-	"There are too many of this thing pending already.",
-	"No site licenses found",
-	"The WG couldn't send a response because we exceeded max network send size",
-	"The user is not mutually friends",
-	"The user is limited",
-	"Item can't be removed",
-	"Account has been deleted",
-	"A license for this already exists, but cancelled",
-	"Access is denied because of a community cooldown (probably from support profile data resets)",
-	"No launcher was specified, but a launcher was needed to choose correct realm for operation.",
-	"User must agree to china SSA or global SSA before login",
-	"The specified launcher type is no longer supported; the user should be directed elsewhere",
-	"The user's realm does not match the realm of the requested resource",
-	"Signature check did not match",
-	"Failed to parse input",
-	"Account does not have a verified phone number",
-	"User device doesn't have enough battery charge currently to complete the action",
-	"The operation requires a charger to be plugged in, which wasn't present",
-	"Cached credential was invalid - user must reauthenticate",
-	"The phone number provided is a Voice Over IP number"
+	{ "No result.", false },
+	{ "Success.", false },
+	{ "Generic failure.", true },
+	{ "Your Steam client doesn't have a connection to the back-end.", true },
+	{ "NoConnectionRetry: This should never appear unless Valve is trolling.", false },
+	{ "Password/ticket is invalid.", false },
+	{ "The user is logged in elsewhere.", false },
+	{ "Protocol version is incorrect.", false },
+	{ "A parameter is incorrect.", false },
+	{ "File was not found.", false },
+	{ "Called method is busy - action not taken.", true },
+	{ "Called object was in an invalid state.", false },
+	{ "The name was invalid.", false },
+	{ "The email was invalid.", false },
+	{ "The name is not unique.", false },
+	{ "Access is denied.", false },
+	{ "Operation timed out.", true },
+	{ "The user is VAC2 banned.", false },
+	{ "Account not found.", false },
+	{ "The Steam ID was invalid.", false },
+	{ "The requested service is currently unavailable.", true },
+	{ "The user is not logged on.", false },
+	{ "Request is pending, it may be in process or waiting on third party.", true },
+	{ "Encryption or Decryption failed.", false },
+	{ "Insufficient privilege.", false },
+	{ "Too much of a good thing.", true },
+	{ "Access has been revoked (used for revoked guest passes.)", false },
+	{ "License/Guest pass the user is trying to access is expired.", false },
+	{ "Guest pass has already been redeemed by account, cannot be used again.", false },
+	{ "The request is a duplicate and the action has already occurred in the past, ignored this time.", false },
+	{ "All the games in this guest pass redemption request are already owned by the user.", false },
+	{ "IP address not found.", false },
+	{ "Failed to write change to the data store.", false },
+	{ "Failed to acquire access lock for this operation.", false },
+	{ "The logon session has been replaced.", false },
+	{ "Failed to connect.", false },
+	{ "The authentication handshake has failed.", false },
+	{ "There has been a generic IO failure.", true },
+	{ "The remote server has disconnected.", false },
+	{ "Failed to find the shopping cart requested.", false },
+	{ "A user blocked the action.", false },
+	{ "The target is ignoring sender.", false },
+	{ "Nothing matching the request found.", false },
+	{ "The account is disabled.", false },
+	{ "This service is not accepting content changes right now.", true },
+	{ "Account doesn't have value, so this feature isn't available.", false },
+	{ "Allowed to take this action, but only because requester is admin.", false },
+	{ "A Version mismatch in content transmitted within the Steam protocol.", false },
+	{ "The current CM can't service the user making a request, user should try another.", true },
+	{ "You are already logged in elsewhere, this cached credential login has failed.", false },
+	{ "The user is logged in elsewhere. (Use instead!)", false },
+	{ "Long running operation has suspended/paused. (eg. content download.)", false },
+	{ "Operation has been canceled, typically by user. (eg. a content download.)", false },
+	{ "Operation canceled because data is ill formed or unrecoverable.", false },
+	{ "Operation canceled - not enough disk space.", false },
+	{ "The remote or IPC call has failed.", false },
+	{ "Password could not be verified as it's unset server side.", false },
+	{ "External account (PSN, Facebook...) is not linked to a Steam account.", false },
+	{ "PSN ticket was invalid.", false },
+	{ "External account (PSN, Facebook...) is already linked to some other account, must explicitly request to replace/delete the link first.", false },
+	{ "The sync cannot resume due to a conflict between the local and remote files.", false },
+	{ "The requested new password is not allowed.", false },
+	{ "New value is the same as the old one. This is used for secret question and answer.", false },
+	{ "Account login denied due to 2nd factor authentication failure.", false },
+	{ "The requested new password is not legal.", false },
+	{ "Account login denied due to auth code invalid.", false },
+	{ "Account login denied due to 2nd factor auth failure - and no mail has been sent.", false },
+	{ "The users hardware does not support Intel's Identity Protection Technology (IPT).", false },
+	{ "Intel's Identity Protection Technology (IPT) has failed to initialize.", false },
+	{ "Operation failed due to parental control restrictions for current user.", false },
+	{ "Facebook query returned an error.", false },
+	{ "Account login denied due to an expired auth code.", false },
+	{ "The login failed due to an IP restriction.", false },
+	{ "The current users account is currently locked for use. This is likely due to a hijacking and pending ownership verification.", false },
+	{ "The logon failed because the accounts email is not verified.", false },
+	{ "There is no URL matching the provided values.", false },
+	{ "Bad Response due to a Parse failure, missing field, etc.", false },
+	{ "The user cannot complete the action until they re-enter their password.", false },
+	{ "The value entered is outside the acceptable range.", false },
+	{ "Something happened that we didn't expect to ever happen.", true },
+	{ "The requested service has been configured to be unavailable.", false },
+	{ "The files submitted to the CEG server are not valid.", false },
+	{ "The device being used is not allowed to perform this action.", false },
+	{ "The action could not be complete because it is region restricted.", false },
+	{ "Temporary rate limit exceeded, try again later, different from which may be permanent.", true },
+	{ "Need two-factor code to login.", false },
+	{ "The thing we're trying to access has been deleted.", false },
+	{ "Login attempt failed, try to throttle response to possible attacker.", false },
+	{ "Two factor authentication (Steam Guard) code is incorrect.", false },
+	{ "The activation code for two-factor authentication (Steam Guard) didn't match.", false },
+	{ "The current account has been associated with multiple partners.", false },
+	{ "The data has not been modified.", false },
+	{ "The account does not have a mobile device associated with it.", false },
+	{ "The time presented is out of range or tolerance.", false },
+	{ "SMS code failure - no match, none pending, etc.", false },
+	{ "Too many accounts access this resource.", false },
+	{ "Too many changes to this account.", false },
+	{ "Too many changes to this phone.", false },
+	{ "Cannot refund to payment method, must use wallet.", false },
+	{ "Cannot send an email.", false },
+	{ "Can't perform operation until payment has settled.", false },
+	{ "The user needs to provide a valid captcha.", false },
+	{ "A game server login token owned by this token's owner has been banned.", false },
+	{ "Game server owner is denied for some other reason such as account locked, community ban, vac ban, missing phone, etc.", false },
+	{ "The type of thing we were requested to act on is invalid.", false },
+	{ "The IP address has been banned from taking this action.", false },
+	{ "This Game Server Login Token (GSLT) has expired from disuse; it can be reset for use.", false },
+	{ "User doesn't have enough wallet funds to complete the action.", false },
+	{ "There are too many of this thing pending already.", true },
+	{ "No site licenses found", false },
+	{ "The WG couldn't send a response because we exceeded max network send size", false },
+	{ "The user is not mutually friends", false },
+	{ "The user is limited", false },
+	{ "Item can't be removed", false },
+	{ "Account has been deleted", false },
+	{ "A license for this already exists, but cancelled", false },
+	{ "Access is denied because of a community cooldown (probably from support profile data resets)", false },
+	{ "No launcher was specified, but a launcher was needed to choose correct realm for operation.", false },
+	{ "User must agree to china SSA or global SSA before login", false },
+	{ "The specified launcher type is no longer supported; the user should be directed elsewhere", false },
+	{ "The user's realm does not match the realm of the requested resource", false },
+	{ "Signature check did not match", false },
+	{ "Failed to parse input", false },
+	{ "Account does not have a verified phone number", false },
+	{ "User device doesn't have enough battery charge currently to complete the action", false },
+	{ "The operation requires a charger to be plugged in, which wasn't present", false },
+	{ "Cached credential was invalid - user must reauthenticate", false },
+	{ "The phone number provided is a Voice Over IP number", false }
 };
+
+inline bool IsRetryableSteamResult(EResult eResult)
+{
+	return eResult >= 0 && eResult < (int)ARRAYSIZE(g_SteamErrorMessages) && g_SteamErrorMessages[eResult].m_bRetryable;
+}
+
+// Results newer than the table (Steam keeps adding them) get a generic message
+inline const char *GetSteamResultMessage(EResult eResult)
+{
+	return eResult >= 0 && eResult < (int)ARRAYSIZE(g_SteamErrorMessages) ? g_SteamErrorMessages[eResult].m_pszMessage : "Unknown error";
+}
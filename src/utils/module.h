@@ -22,8 +22,12 @@
 #include "interface.h"
 #include "strtools.h"
 #include "plat.h"
+#include "sigscan.h"
+#include "workerpool.h"
 
+#include <algorithm>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -38,6 +42,16 @@ enum SigError
 	SIG_FOUND_MULTIPLE,
 };
 
+// One entry of a CModule::FindSignatures batch
+struct Signature_t
+{
+	const char *m_pszName;
+	const byte *m_pData;
+	size_t m_iLength;
+	void **m_ppAddress; // Receives the first match, nullptr if not found
+	int m_iError = SIG_OK;
+};
+
 // equivalent to FindSignature, but allows for multiple signatures to be found and iterated over
 class SignatureIterator
 {
@@ -50,21 +64,14 @@ public:
 
 	void *FindNext(bool allowWildcard)
 	{
-		for (size_t i = 0; i < m_iSize; i++)
-		{
-			size_t Matches = 0;
-			while (*(m_pCurrent + i + Matches) == m_pSignature[Matches] || (allowWildcard && m_pSignature[Matches] == '\x2A'))
-			{
-				Matches++;
-				if (Matches == m_iSigLength)
-				{
-					m_pCurrent += i + 1;
-					return m_pCurrent - 1;
-				}
-			}
-		}
+		CSignatureScanner scanner(m_pSignature, m_iSigLength, allowWildcard);
+		const byte *pMatch = scanner.Find(m_pCurrent, m_pBase + m_iSize);
 
-		return nullptr;
+		if (!pMatch)
+			return nullptr;
+
+		m_pCurrent = (byte *)pMatch + 1;
+		return (void *)pMatch;
 	}
 private:
 	byte *m_pBase;
@@ -100,40 +107,105 @@ public:
 		if (int e = GetModuleInformation(m_hModule, &m_base, &m_size, m_sections))
 			Error("Failed to get module info for %s, error %d\n", szModule, e);
 #endif
+
+		InitializeBuildId(szModule);
 	}
 
 	void *FindSignature(const byte *pData, size_t iSigLength, int &error)
 	{
-		unsigned char *pMemory;
-		void *return_addr = nullptr;
+		const byte *pMemory = (byte *)m_base;
+		const byte *pEnd = pMemory + m_size;
 		error = 0;
 
-		pMemory = (byte *)m_base;
+		CSignatureScanner scanner(pData, iSigLength, true);
+		const byte *pMatch = scanner.Find(pMemory, pEnd);
+
+		if (!pMatch)
+		{
+			error = SIG_NOT_FOUND;
+			return nullptr;
+		}
+
+		// Any second match counts, including one overlapping the first
+		if (scanner.Find(pMatch + 1, pEnd))
+			error = SIG_FOUND_MULTIPLE;
+
+		return (void *)pMatch;
+	}
+
+	// Resolves every signature in a single pass over the module, each one gets its own error.
+	// With a pool the module is split into contiguous parts searched in parallel, then merged in address order so the results are the same.
+	void FindSignatures(Signature_t *pSignatures, size_t nSignatures, const CWorkerPool *pPool = nullptr)
+	{
+		constexpr size_t nMinPartSize = 4 * 1024 * 1024;
+
+		std::vector<CSignatureScanner> scanners;
+		scanners.reserve(nSignatures);
+
+		for (size_t i = 0; i < nSignatures; i++)
+			scanners.emplace_back(pSignatures[i].m_pData, pSignatures[i].m_iLength, true);
 
-		for (size_t i = 0; i < m_size; i++)
+		size_t nParts = pPool ? std::max<size_t>(std::min<size_t>(pPool->GetThreadCount(), m_size / nMinPartSize), 1) : 1;
+		size_t nPartSize = (m_size + nParts - 1) / nParts;
+		const byte *pEnd = (byte *)m_base + m_size;
+
+		std::vector<std::vector<CSignatureScanner::Result_t>> partResults(nParts, std::vector<CSignatureScanner::Result_t>(nSignatures));
+		std::vector<std::function<void()>> tasks;
+
+		for (size_t i = 0; i < nParts; i++)
 		{
-			size_t Matches = 0;
-			while (*(pMemory + i + Matches) == pData[Matches] || pData[Matches] == '\x2A')
+			tasks.push_back([&, i]()
 			{
-				Matches++;
-				if (Matches == iSigLength)
-				{
-					if (return_addr)
-					{
-						error = SIG_FOUND_MULTIPLE;
-						return return_addr;
-					}
-
-					return_addr = (void *)(pMemory + i);
-					break;
-				}
+				const byte *pStart = (byte *)m_base + i * nPartSize;
+				CSignatureScanner::FindAll(scanners.data(), partResults[i].data(), nSignatures, pStart, pStart + std::min(nPartSize, (size_t)(pEnd - pStart)), pEnd);
+			});
+		}
+
+		if (pPool)
+			pPool->Run(tasks);
+		else
+			tasks[0]();
+
+		for (size_t i = 0; i < nSignatures; i++)
+		{
+			Signature_t &sig = pSignatures[i];
+			const byte *pMatch = nullptr;
+			bool bMultiple = false;
+
+			for (size_t j = 0; j < nParts && !bMultiple; j++)
+			{
+				const CSignatureScanner::Result_t &result = partResults[j][i];
+
+				if (!result.m_pMatch)
+					continue;
+
+				bMultiple = pMatch || result.m_bMultiple;
+
+				if (!pMatch)
+					pMatch = result.m_pMatch;
 			}
+
+			*sig.m_ppAddress = (void *)pMatch;
+
+			if (!pMatch)
+				sig.m_iError = SIG_NOT_FOUND;
+			else if (bMultiple)
+				sig.m_iError = SIG_FOUND_MULTIPLE;
+			else
+				sig.m_iError = SIG_OK;
 		}
+	}
 
-		if (!return_addr)
-			error = SIG_NOT_FOUND;
+	// Whether the signature matches at pAddress, which can be any pointer
+	bool MatchesSignature(const void *pAddress, const byte *pData, size_t iSigLength)
+	{
+		const byte *pMemory = (byte *)m_base;
 
-		return return_addr;
+		if (pAddress < pMemory || iSigLength > m_size || (const byte *)pAddress > pMemory + m_size - iSigLength)
+			return false;
+
+		CSignatureScanner scanner(pData, iSigLength, true);
+		return scanner.Find((const byte *)pAddress, (const byte *)pAddress + iSigLength) == pAddress;
 	}
 
 	void *FindInterface(const char *name)
@@ -161,10 +233,22 @@ public:
 
 		return nullptr;
 	}
+
+	static bool IsInSection(const Section *pSection, const void *pAddress, size_t iSize)
+	{
+		uintptr_t nStart = (uintptr_t)pSection->m_pBase;
+		uintptr_t nAddress = (uintptr_t)pAddress;
+
+		return pSection->m_iSize >= iSize && nAddress >= nStart && nAddress - nStart <= pSection->m_iSize - iSize;
+	}
 #ifdef _WIN32
 	void InitializeSections();
 #endif
+	void InitializeBuildId(const char *pszPath);
+	void IndexVirtualTables();
 	void *FindVirtualTable(const std::string &name);
+	// Cheaply checks that a vtable found earlier, e.g. by an older run, really is the one for this class
+	bool IsVirtualTable(void *pVTable, const std::string &name);
 public:
 	const char *m_pszModule;
 	const char *m_pszPath;
@@ -172,4 +256,9 @@ public:
 	void *m_base;
 	size_t m_size;
 	std::vector<Section> m_sections;
+	// Identifies this exact build of the module, empty if it can't be told apart from other builds
+	std::string m_sBuildId;
+	// Decorated class name to primary vtable, built by the first FindVirtualTable
+	std::unordered_map<std::string, void *> m_VirtualTables;
+	bool m_bVirtualTablesIndexed = false;
 };
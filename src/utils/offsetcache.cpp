@@ -0,0 +1,160 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "offsetcache.h"
+#include <stdio.h>
+
+#include "tier0/memdbgon.h"
+
+COffsetCache g_OffsetCache;
+
+static std::string GetKey(const char *pszModule, const char *pszKind, const std::string &name)
+{
+	return std::string(pszModule) + " " + pszKind + " " + name;
+}
+
+void COffsetCache::Load(const char *pszPath)
+{
+	m_sPath = pszPath;
+	m_Entries.clear();
+	m_bDirty = false;
+
+	FILE *pFile = fopen(pszPath, "r");
+
+	if (!pFile)
+		return;
+
+	char szLine[512];
+
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		char szModule[128], szBuildId[128], szKind[16], szName[128];
+		long long nOffset;
+
+		if (sscanf(szLine, "%127s %127s %15s %127s %lld", szModule, szBuildId, szKind, szName, &nOffset) != 5 || szModule[0] == '/')
+			continue;
+
+		m_Entries[GetKey(szModule, szKind, szName)] = { szModule, szKind, szName, szBuildId, (int64_t)nOffset };
+	}
+
+	fclose(pFile);
+}
+
+void COffsetCache::Save()
+{
+	if (!m_bDirty || m_sPath.empty())
+		return;
+
+	FILE *pFile = fopen(m_sPath.c_str(), "w");
+
+	if (!pFile)
+	{
+		Warning("%s: Failed to write %s\n", __func__, m_sPath.c_str());
+		return;
+	}
+
+	fprintf(pFile, "// Signature and vtable offsets from the module base, written automatically. Module, build ID, kind, name, offset\n");
+
+	for (const auto &it : m_Entries)
+	{
+		const Entry_t &entry = it.second;
+		fprintf(pFile, "%s %s %s %s %lld\n", entry.m_sModule.c_str(), entry.m_sBuildId.c_str(), entry.m_sKind.c_str(), entry.m_sName.c_str(), (long long)entry.m_nOffset);
+	}
+
+	fclose(pFile);
+	m_bDirty = false;
+}
+
+void *COffsetCache::Lookup(const CModule &module, const char *pszKind, const std::string &name)
+{
+	if (module.m_sBuildId.empty())
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Entries.find(GetKey(module.m_pszModule, pszKind, name));
+
+	if (it == m_Entries.end() || it->second.m_sBuildId != module.m_sBuildId)
+		return nullptr;
+
+	return (void *)((uintptr_t)module.m_base + it->second.m_nOffset);
+}
+
+void COffsetCache::Store(const CModule &module, const char *pszKind, const std::string &name, const void *pAddress)
+{
+	// Names end up as a single word in the file
+	if (module.m_sBuildId.empty() || name.empty() || name.find_first_of(" \t\r\n") != std::string::npos)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Entries[GetKey(module.m_pszModule, pszKind, name)] = { module.m_pszModule, pszKind, name, module.m_sBuildId, (int64_t)((uintptr_t)pAddress - (uintptr_t)module.m_base) };
+	m_bDirty = true;
+}
+
+void COffsetCache::FindSignatures(CModule &module, Signature_t *pSignatures, size_t nSignatures, const CWorkerPool *pPool)
+{
+	std::vector<Signature_t> missing;
+	std::vector<size_t> missingIndices;
+
+	for (size_t i = 0; i < nSignatures; i++)
+	{
+		Signature_t &sig = pSignatures[i];
+		void *pAddress = Lookup(module, "sig", sig.m_pszName);
+
+		if (pAddress && module.MatchesSignature(pAddress, sig.m_pData, sig.m_iLength))
+		{
+			*sig.m_ppAddress = pAddress;
+			sig.m_iError = SIG_OK;
+			continue;
+		}
+
+		missing.push_back(sig);
+		missingIndices.push_back(i);
+	}
+
+	if (missing.empty())
+		return;
+
+	module.FindSignatures(missing.data(), missing.size(), pPool);
+
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		Signature_t &sig = pSignatures[missingIndices[i]];
+		sig.m_iError = missing[i].m_iError;
+
+		// Signatures matching several places are left for the next load to report again
+		if (sig.m_iError == SIG_OK)
+			Store(module, "sig", sig.m_pszName, *sig.m_ppAddress);
+	}
+}
+
+void *COffsetCache::FindVirtualTable(CModule &module, const std::string &name)
+{
+	void *pVTable = Lookup(module, "vtable", name);
+
+	if (pVTable && module.IsVirtualTable(pVTable, name))
+		return pVTable;
+
+	pVTable = module.FindVirtualTable(name);
+
+	if (pVTable)
+		Store(module, "vtable", name, pVTable);
+
+	return pVTable;
+}
@@ -0,0 +1,64 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include "module.h"
+#include <map>
+#include <mutex>
+#include <string>
+
+// Remembers where signatures and vtables were found, relative to the module base, so later loads of the same build skip the scans.
+// Entries are keyed by module and name and only used while the module's build ID is unchanged. Even then they're checked before
+// being trusted, a signature has to still match at the cached offset and a vtable has to still point at its class's type info.
+// Anything that fails is scanned for as usual and the result replaces the entry.
+// Lookups for different modules can run on different threads, Load and Save are main thread only.
+class COffsetCache
+{
+public:
+	void Load(const char *pszPath);
+	// Writes the file back if anything changed since it was loaded
+	void Save();
+
+	// Same as CModule::FindSignatures
+	void FindSignatures(CModule &module, Signature_t *pSignatures, size_t nSignatures, const CWorkerPool *pPool = nullptr);
+	// Same as CModule::FindVirtualTable
+	void *FindVirtualTable(CModule &module, const std::string &name);
+
+private:
+	struct Entry_t
+	{
+		std::string m_sModule;
+		std::string m_sKind;
+		std::string m_sName;
+		std::string m_sBuildId;
+		int64_t m_nOffset;
+	};
+
+	// Returns nullptr if there's no entry for this build of the module
+	void *Lookup(const CModule &module, const char *pszKind, const std::string &name);
+	void Store(const CModule &module, const char *pszKind, const std::string &name, const void *pAddress);
+
+	std::mutex m_Mutex;
+	std::string m_sPath;
+	std::map<std::string, Entry_t> m_Entries;
+	bool m_bDirty = false;
+};
+
+extern COffsetCache g_OffsetCache;
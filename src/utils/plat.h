@@ -60,4 +60,34 @@ int GetModuleInformation(HINSTANCE module, void **base, size_t *length, std::vec
 #define MODULE_EXT ".so"
 #endif
 
-void Plat_WriteMemory(void *pPatchAddress, uint8_t *pPatch, int iPatchSize);
\ No newline at end of file
+void Plat_WriteMemory(void *pPatchAddress, uint8_t *pPatch, int iPatchSize);
+
+// A file mapped read/write and shared, so writes to the mapping end up in the file and are visible to other processes mapping it
+struct MappedFile
+{
+	uint8_t *pData = nullptr;
+	size_t nSize = 0;
+#ifdef _WIN32
+	void *hFile = nullptr;
+	void *hMapping = nullptr;
+#else
+	int fd = -1;
+#endif
+	bool bLocked = false;
+};
+
+// Opens or creates the file, growing it to at least nMinSize bytes. New bytes read as zero.
+// Files are never shrunk, so mappings other processes made before the file grew stay valid.
+bool Plat_MapFile(const char *pszPath, size_t nMinSize, MappedFile &file);
+// Grows the file to at least nMinSize bytes and remaps it if the mapping is smaller, pData can change
+bool Plat_GrowMappedFile(MappedFile &file, size_t nMinSize);
+void Plat_UnmapFile(MappedFile &file);
+// Exclusive lock on the file shared with other processes, blocks until it's free. Not recursive.
+// Plat_GrowMappedFile doesn't lock again while it's held
+bool Plat_LockMappedFile(MappedFile &file);
+void Plat_UnlockMappedFile(MappedFile &file);
+// Schedules the given range to be written back to disk without waiting for it
+void Plat_FlushMappedFile(MappedFile &file, size_t nOffset, size_t nLength);
+
+// The modification time is in a platform specific unit, only good for comparing against another call
+bool Plat_GetFileInfo(const char *pszPath, uint64_t &nSize, int64_t &nModifiedTime);
\ No newline at end of file
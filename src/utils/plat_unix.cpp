@@ -35,6 +35,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/file.h>
+#include <errno.h>
 
 #include "tier0/memdbgon.h"
 
@@ -206,38 +208,238 @@ void Plat_WriteMemory(void *pPatchAddress, uint8_t *pPatch, int iPatchSize)
 	result = mprotect(align_addr, align_size, old_prot);
 }
 
-void *CModule::FindVirtualTable(const std::string &name)
+bool Plat_MapFile(const char *pszPath, size_t nMinSize, MappedFile &file)
 {
-	auto readOnlyData = GetSection(".rodata");
-	auto readOnlyRelocations = GetSection(".data.rel.ro");
+	int fd = open(pszPath, O_RDWR | O_CREAT, 0644);
+	if (fd == -1)
+		return false;
 
-	if (!readOnlyData || !readOnlyRelocations)
+	file.fd = fd;
+
+	if (!Plat_GrowMappedFile(file, nMinSize))
 	{
-		Warning("Failed to find .rodata or .data.rel.ro section\n");
-		return nullptr;
+		Plat_UnmapFile(file);
+		return false;
 	}
 
-	std::string decoratedTableName = std::to_string(name.length()) + name;
+	return true;
+}
+
+// The caller holds the file lock, so nobody else can change the size between the fstat and the ftruncate
+static bool GrowFile(int fd, size_t nMinSize, size_t &nSize)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return false;
+
+	if ((size_t)st.st_size < nMinSize && ftruncate(fd, nMinSize) != 0)
+		return false;
+
+	nSize = MAX((size_t)st.st_size, nMinSize);
+	return true;
+}
+
+bool Plat_GrowMappedFile(MappedFile &file, size_t nMinSize)
+{
+	if (file.fd == -1)
+		return false;
+
+	if (file.pData && file.nSize >= nMinSize)
+		return true;
+
+	// Another process could be growing the file too, without the lock it could see the old size and truncate it back
+	bool bLock = !file.bLocked;
+	if (bLock && !Plat_LockMappedFile(file))
+		return false;
+
+	size_t nSize;
+	bool bGrown = GrowFile(file.fd, nMinSize, nSize);
+
+	if (bLock)
+		Plat_UnlockMappedFile(file);
 
-	SignatureIterator sigIt(readOnlyData->m_pBase, readOnlyData->m_iSize, (const byte *)decoratedTableName.c_str(), decoratedTableName.size() + 1);
-	void *classNameString = sigIt.FindNext(false);
+	if (!bGrown)
+		return false;
 
-	if (!classNameString)
+	void *map = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+	if (map == MAP_FAILED)
+		return false;
+
+	if (file.pData)
+		munmap(file.pData, file.nSize);
+
+	file.pData = (uint8_t *)map;
+	file.nSize = nSize;
+
+	return true;
+}
+
+void Plat_UnmapFile(MappedFile &file)
+{
+	if (file.pData)
+		munmap(file.pData, file.nSize);
+
+	if (file.fd != -1)
+		close(file.fd);
+
+	file = MappedFile();
+}
+
+bool Plat_LockMappedFile(MappedFile &file)
+{
+	while (flock(file.fd, LOCK_EX) != 0)
 	{
-		Warning("Failed to find type descriptor for %s\n", name.c_str());
-		return nullptr;
+		if (errno != EINTR)
+			return false;
 	}
 
-	SignatureIterator sigIt2(readOnlyRelocations->m_pBase, readOnlyRelocations->m_iSize, (const byte *)&classNameString, sizeof(void *));
-	void *typeName = sigIt2.FindNext(false);
+	file.bLocked = true;
+	return true;
+}
+
+void Plat_UnlockMappedFile(MappedFile &file)
+{
+	if (!file.bLocked)
+		return;
+
+	flock(file.fd, LOCK_UN);
+	file.bLocked = false;
+}
+
+void Plat_FlushMappedFile(MappedFile &file, size_t nOffset, size_t nLength)
+{
+	if (!file.pData || !nLength)
+		return;
+
+	// msync wants a page aligned address
+	uintptr_t page_size = sysconf(_SC_PAGESIZE);
+	size_t nAlignedOffset = nOffset & ~(page_size - 1);
 
-	if (!typeName)
+	msync(file.pData + nAlignedOffset, nLength + (nOffset - nAlignedOffset), MS_ASYNC);
+}
+
+bool Plat_GetFileInfo(const char *pszPath, uint64_t &nSize, int64_t &nModifiedTime)
+{
+	struct stat info;
+	if (stat(pszPath, &info) != 0)
+		return false;
+
+	nSize = info.st_size;
+	nModifiedTime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+
+	return true;
+}
+
+struct BuildIdQuery_t
+{
+	ElfW(Addr) m_nAddress; // in
+	std::string *m_pBuildId; // out
+};
+
+static int FindBuildIdNote(dl_phdr_info *info, size_t size, void *data)
+{
+	BuildIdQuery_t *pQuery = (BuildIdQuery_t *)data;
+
+	if (info->dlpi_addr != pQuery->m_nAddress)
+		return 0;
+
+	for (auto i = 0; i < info->dlpi_phnum; ++i)
 	{
-		Warning("Failed to find type name for %s\n", name.c_str());
-		return nullptr;
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+		if (phdr->p_type != PT_NOTE)
+			continue;
+
+		// Notes are padded to the alignment of their segment
+		size_t nAlign = phdr->p_align == 8 ? 8 : 4;
+		const uint8_t *pNote = (const uint8_t *)(info->dlpi_addr + phdr->p_vaddr);
+		const uint8_t *pEnd = pNote + phdr->p_memsz;
+
+		while (pNote + sizeof(ElfW(Nhdr)) <= pEnd)
+		{
+			const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)pNote;
+			const uint8_t *pName = pNote + sizeof(ElfW(Nhdr));
+			const uint8_t *pDesc = pName + ((nhdr->n_namesz + nAlign - 1) & ~(nAlign - 1));
+
+			if (pDesc + nhdr->n_descsz > pEnd)
+				break;
+
+			if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && !memcmp(pName, "GNU", 4))
+			{
+				char szByte[3];
+
+				for (ElfW(Word) j = 0; j < nhdr->n_descsz; j++)
+				{
+					snprintf(szByte, sizeof(szByte), "%02x", pDesc[j]);
+					*pQuery->m_pBuildId += szByte;
+				}
+
+				return 1;
+			}
+
+			pNote = pDesc + ((nhdr->n_descsz + nAlign - 1) & ~(nAlign - 1));
+		}
+	}
+
+	return 1;
+}
+
+// The build ID the linker stamps into the module, or the size and modification time of the file if it doesn't have one
+void CModule::InitializeBuildId(const char *pszPath)
+{
+	m_sBuildId.clear();
+
+	link_map *lmap;
+	if (dlinfo(m_hModule, RTLD_DI_LINKMAP, &lmap) == 0)
+	{
+		BuildIdQuery_t query { lmap->l_addr, &m_sBuildId };
+		dl_iterate_phdr(FindBuildIdNote, &query);
+	}
+
+	uint64_t nSize;
+	int64_t nModifiedTime;
+
+	if (m_sBuildId.empty() && Plat_GetFileInfo(pszPath, nSize, nModifiedTime))
+		m_sBuildId = std::to_string(nSize) + "-" + std::to_string(nModifiedTime);
+}
+
+// Whether the string looks like the mangled name of a class, e.g. 16CServerSideClient or N8CNetwork6CStateE
+static bool IsTypeName(const Section *pSection, const char *pszName)
+{
+	if (!(*pszName >= '0' && *pszName <= '9') && *pszName != 'N')
+		return false;
+
+	const char *pszEnd = (const char *)pSection->m_pBase + pSection->m_iSize;
+
+	for (const char *psz = pszName; psz < pszEnd && psz - pszName < 1024; psz++)
+	{
+		if (*psz == '\0')
+			return true;
+
+		if (!isalnum((unsigned char)*psz) && *psz != '_')
+			return false;
+	}
+
+	return false;
+}
+
+// One sweep over the relocated read-only data finds every type info and primary vtable.
+// A type info's second pointer is its mangled name in .rodata, a primary vtable is preceded by a zero offset to top and a pointer to its type info.
+void CModule::IndexVirtualTables()
+{
+	m_bVirtualTablesIndexed = true;
+
+	auto readOnlyData = GetSection(".rodata");
+	auto readOnlyRelocations = GetSection(".data.rel.ro");
+
+	if (!readOnlyData || !readOnlyRelocations)
+	{
+		Warning("Failed to find .rodata or .data.rel.ro section\n");
+		return;
 	}
 
-	void *typeInfo = (void *)((uintptr_t)typeName - 0x8);
+	// Only the first of each is kept, like the searches this replaced
+	std::unordered_map<std::string_view, void *> typeInfos;
+	std::unordered_map<void *, void *> vtables;
 
 	for (const auto &sectionName : {std::string_view(".data.rel.ro"), std::string_view(".data.rel.ro.local")})
 	{
@@ -245,16 +447,77 @@ void *CModule::FindVirtualTable(const std::string &name)
 		if (!section)
 			continue;
 
-		SignatureIterator sigIt3(section->m_pBase, section->m_iSize, (const byte *)&typeInfo, sizeof(void *));
+		uintptr_t nStart = ((uintptr_t)section->m_pBase + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+		uintptr_t nEnd = ((uintptr_t)section->m_pBase + section->m_iSize) & ~(sizeof(void *) - 1);
 
-		while (void *vtable = sigIt3.FindNext(false))
+		for (void **ppSlot = (void **)nStart + 1; ppSlot < (void **)nEnd; ppSlot++)
 		{
-			if (*(int64_t *)((uintptr_t)vtable - 0x8) == 0)
-				return (void *)((uintptr_t)vtable + 0x8);
+			void *pValue = *ppSlot;
+
+			if (section == readOnlyRelocations && IsInSection(readOnlyData, pValue, 1))
+			{
+				if (IsTypeName(readOnlyData, (const char *)pValue))
+					typeInfos.emplace((const char *)pValue, ppSlot - 1);
+			}
+			else if (ppSlot[-1] == nullptr && IsInSection(readOnlyRelocations, pValue, 2 * sizeof(void *)))
+			{
+				vtables.emplace(pValue, ppSlot + 1);
+			}
 		}
 	}
 
-	Warning("Failed to find vtable for %s\n", name.c_str());
-	return nullptr;
+	for (const auto &typeInfo : typeInfos)
+	{
+		auto vtable = vtables.find(typeInfo.second);
+		if (vtable != vtables.end())
+			m_VirtualTables.emplace(typeInfo.first, vtable->second);
+	}
+}
+
+void *CModule::FindVirtualTable(const std::string &name)
+{
+	if (!m_bVirtualTablesIndexed)
+		IndexVirtualTables();
+
+	std::string decoratedTableName = std::to_string(name.length()) + name;
+
+	auto it = m_VirtualTables.find(decoratedTableName);
+	if (it == m_VirtualTables.end())
+	{
+		Warning("Failed to find vtable for %s\n", name.c_str());
+		return nullptr;
+	}
+
+	return it->second;
+}
+
+// Walks back the same way FindVirtualTable got there: offset to top, type info, then its name
+bool CModule::IsVirtualTable(void *pVTable, const std::string &name)
+{
+	auto readOnlyData = GetSection(".rodata");
+	auto readOnlyRelocations = GetSection(".data.rel.ro");
+	auto readOnlyRelocationsLocal = GetSection(".data.rel.ro.local");
+
+	if (!readOnlyData || !readOnlyRelocations)
+		return false;
+
+	void **ppVTable = (void **)pVTable - 2;
+
+	if (!IsInSection(readOnlyRelocations, ppVTable, 2 * sizeof(void *))
+		&& (!readOnlyRelocationsLocal || !IsInSection(readOnlyRelocationsLocal, ppVTable, 2 * sizeof(void *))))
+		return false;
+
+	if (ppVTable[0] != nullptr)
+		return false;
+
+	void **ppTypeInfo = (void **)ppVTable[1];
+
+	if (!IsInSection(readOnlyRelocations, ppTypeInfo, 2 * sizeof(void *)))
+		return false;
+
+	std::string decoratedTableName = std::to_string(name.length()) + name;
+	const char *pszTypeName = (const char *)ppTypeInfo[1];
+
+	return IsInSection(readOnlyData, pszTypeName, decoratedTableName.size() + 1) && !memcmp(pszTypeName, decoratedTableName.c_str(), decoratedTableName.size() + 1);
 }
 #endif
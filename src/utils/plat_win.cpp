@@ -31,6 +31,125 @@ void Plat_WriteMemory(void *pPatchAddress, uint8_t *pPatch, int iPatchSize)
 }
 
 
+bool Plat_MapFile(const char *pszPath, size_t nMinSize, MappedFile &file)
+{
+	HANDLE hFile = CreateFileA(pszPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	file.hFile = hFile;
+
+	if (!Plat_GrowMappedFile(file, nMinSize))
+	{
+		Plat_UnmapFile(file);
+		return false;
+	}
+
+	return true;
+}
+
+bool Plat_GrowMappedFile(MappedFile &file, size_t nMinSize)
+{
+	if (!file.hFile)
+		return false;
+
+	if (file.pData && file.nSize >= nMinSize)
+		return true;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file.hFile, &fileSize))
+		return false;
+
+	// The mapping grows the file on its own and never shrinks it, even if another process grew it since we got the size.
+	// The extended part is zero filled
+	size_t nSize = MAX((size_t)fileSize.QuadPart, nMinSize);
+	HANDLE hMapping = CreateFileMappingA(file.hFile, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)nSize >> 32), (DWORD)nSize, nullptr);
+	if (!hMapping)
+		return false;
+
+	void *pView = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nSize);
+	if (!pView)
+	{
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	if (file.pData)
+		UnmapViewOfFile(file.pData);
+
+	if (file.hMapping)
+		CloseHandle(file.hMapping);
+
+	file.pData = (uint8_t *)pView;
+	file.nSize = nSize;
+	file.hMapping = hMapping;
+
+	return true;
+}
+
+void Plat_UnmapFile(MappedFile &file)
+{
+	if (file.pData)
+		UnmapViewOfFile(file.pData);
+
+	if (file.hMapping)
+		CloseHandle(file.hMapping);
+
+	if (file.hFile)
+		CloseHandle(file.hFile);
+
+	file = MappedFile();
+}
+
+// Locks a byte far past the end instead of the contents, locking those would make ReadFile and WriteFile on them fail
+static OVERLAPPED GetLockOffset()
+{
+	OVERLAPPED overlapped = {};
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+	return overlapped;
+}
+
+bool Plat_LockMappedFile(MappedFile &file)
+{
+	OVERLAPPED overlapped = GetLockOffset();
+	if (!LockFileEx(file.hFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped))
+		return false;
+
+	file.bLocked = true;
+	return true;
+}
+
+void Plat_UnlockMappedFile(MappedFile &file)
+{
+	if (!file.bLocked)
+		return;
+
+	OVERLAPPED overlapped = GetLockOffset();
+	UnlockFileEx(file.hFile, 0, 1, 0, &overlapped);
+	file.bLocked = false;
+}
+
+void Plat_FlushMappedFile(MappedFile &file, size_t nOffset, size_t nLength)
+{
+	if (!file.pData || !nLength)
+		return;
+
+	// Only queues the dirty pages to be written, FlushFileBuffers would wait for the disk
+	FlushViewOfFile(file.pData + nOffset, nLength);
+}
+
+bool Plat_GetFileInfo(const char *pszPath, uint64_t &nSize, int64_t &nModifiedTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(pszPath, GetFileExInfoStandard, &info))
+		return false;
+
+	nSize = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	nModifiedTime = ((int64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
 void CModule::InitializeSections()
 {
 	IMAGE_DOS_HEADER *pDosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(m_hModule);
@@ -49,59 +168,119 @@ void CModule::InitializeSections()
 	}
 }
 
-void *CModule::FindVirtualTable(const std::string &name)
+// Size and modification time of the file, plus a hash of the PE headers which hold the link timestamp and checksum
+void CModule::InitializeBuildId(const char *pszPath)
 {
+	m_sBuildId.clear();
+
+	uint64_t nSize;
+	int64_t nModifiedTime;
+
+	if (!Plat_GetFileInfo(pszPath, nSize, nModifiedTime))
+		return;
+
+	IMAGE_DOS_HEADER *pDosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(m_hModule);
+	IMAGE_NT_HEADERS *pNtHeader = reinterpret_cast<IMAGE_NT_HEADERS64 *>(reinterpret_cast<uintptr_t>(m_hModule) + pDosHeader->e_lfanew);
+
+	// FNV-1a
+	const uint8_t *pHeaders = reinterpret_cast<const uint8_t *>(m_hModule);
+	uint64_t nHash = 0xcbf29ce484222325ull;
+
+	for (DWORD i = 0; i < pNtHeader->OptionalHeader.SizeOfHeaders; i++)
+	{
+		nHash ^= pHeaders[i];
+		nHash *= 0x100000001b3ull;
+	}
+
+	char szBuildId[64];
+	V_snprintf(szBuildId, sizeof(szBuildId), "%llu-%lld-%016llx", (unsigned long long)nSize, (long long)nModifiedTime, (unsigned long long)nHash);
+	m_sBuildId = szBuildId;
+}
+
+// One sweep over .rdata finds every primary vtable: it's preceded by a pointer to its RTTI Complete Object Locator,
+// which leads to the type descriptor holding the decorated name
+void CModule::IndexVirtualTables()
+{
+	m_bVirtualTablesIndexed = true;
+
 	auto runTimeData = GetSection(".data");
 	auto readOnlyData = GetSection(".rdata");
 
 	if (!runTimeData || !readOnlyData)
 	{
 		Warning("Failed to find .data or .rdata section\n");
-		return nullptr;
+		return;
 	}
 
-	std::string decoratedTableName = ".?AV" + name + "@@";
+	uintptr_t nStart = ((uintptr_t)readOnlyData->m_pBase + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	uintptr_t nEnd = ((uintptr_t)readOnlyData->m_pBase + readOnlyData->m_iSize) & ~(sizeof(void *) - 1);
+	const char *pszDataEnd = (const char *)runTimeData->m_pBase + runTimeData->m_iSize;
 
-	SignatureIterator sigIt(runTimeData->m_pBase, runTimeData->m_iSize, (const byte *)decoratedTableName.c_str(), decoratedTableName.size() + 1);
-	void *typeDescriptor = sigIt.FindNext(false);
+	for (void **ppSlot = (void **)nStart; ppSlot + 1 < (void **)nEnd; ppSlot++)
+	{
+		const uint8_t *pCompleteObjectLocator = (const uint8_t *)*ppSlot;
+
+		if (!IsInSection(readOnlyData, pCompleteObjectLocator, 0x10))
+			continue;
+
+		// check RTTI Complete Object Locator header, always 0x1, and vtable offset, 0 for the primary vtable
+		if (*(int32_t *)pCompleteObjectLocator != 1 || *(int32_t *)(pCompleteObjectLocator + 0x4) != 0)
+			continue;
 
-	if (!typeDescriptor)
+		const char *pszTypeName = (const char *)m_base + *(uint32_t *)(pCompleteObjectLocator + 0xC) + 0x10;
+
+		if (!IsInSection(runTimeData, pszTypeName, 1))
+			continue;
+
+		size_t nLength = strnlen(pszTypeName, pszDataEnd - pszTypeName);
+
+		// Only the first vtable of each class is kept, like the search this replaced
+		if (nLength < (size_t)(pszDataEnd - pszTypeName))
+			m_VirtualTables.emplace(std::string(pszTypeName, nLength), ppSlot + 1);
+	}
+}
+
+void *CModule::FindVirtualTable(const std::string &name)
+{
+	if (!m_bVirtualTablesIndexed)
+		IndexVirtualTables();
+
+	std::string decoratedTableName = ".?AV" + name + "@@";
+
+	auto it = m_VirtualTables.find(decoratedTableName);
+	if (it == m_VirtualTables.end())
 	{
-		Warning("Failed to find type descriptor for %s\n", name.c_str());
+		Warning("Failed to find vtable for %s\n", name.c_str());
 		return nullptr;
 	}
 
-	typeDescriptor = (void *)((uintptr_t)typeDescriptor - 0x10);
+	return it->second;
+}
 
-	const uint32_t rttiTDRva = (uintptr_t)typeDescriptor - (uintptr_t)m_base;
+// Walks back the same way FindVirtualTable got there: Complete Object Locator, then the type descriptor and its name
+bool CModule::IsVirtualTable(void *pVTable, const std::string &name)
+{
+	auto runTimeData = GetSection(".data");
+	auto readOnlyData = GetSection(".rdata");
 
-	ConMsg("RTTI Type Descriptor RVA: 0x%p\n", rttiTDRva);
+	if (!runTimeData || !readOnlyData)
+		return false;
 
-	SignatureIterator sigIt2(readOnlyData->m_pBase, readOnlyData->m_iSize, (const byte *)&rttiTDRva, sizeof(uint32_t));
+	void **ppVTable = (void **)pVTable - 1;
 
-	while (void *completeObjectLocator = sigIt2.FindNext(false))
-	{
-		auto completeObjectLocatorHeader = (uintptr_t)completeObjectLocator - 0xC;
-		// check RTTI Complete Object Locator header, always 0x1
-		if (*(int32_t *)(completeObjectLocatorHeader) != 1)
-			continue;
+	if (!IsInSection(readOnlyData, ppVTable, sizeof(void *)))
+		return false;
 
-		// check RTTI Complete Object Locator vtable offset
-		if (*(int32_t *)((uintptr_t)completeObjectLocator - 0x8) != 0)
-			continue;
+	const uint8_t *pCompleteObjectLocator = (const uint8_t *)*ppVTable;
 
-		SignatureIterator sigIt3(readOnlyData->m_pBase, readOnlyData->m_iSize, (const byte *)&completeObjectLocatorHeader, sizeof(void *));
-		void *vtable = sigIt3.FindNext(false);
+	if (!IsInSection(readOnlyData, pCompleteObjectLocator, 0x10))
+		return false;
 
-		if (!vtable)
-		{
-			Warning("Failed to find vtable for %s\n", name.c_str());
-			return nullptr;
-		}
+	if (*(int32_t *)pCompleteObjectLocator != 1 || *(int32_t *)(pCompleteObjectLocator + 0x4) != 0)
+		return false;
 
-		return (void *)((uintptr_t)vtable + 0x8);
-	}
+	std::string decoratedTableName = ".?AV" + name + "@@";
+	const char *pszTypeName = (const char *)m_base + *(uint32_t *)(pCompleteObjectLocator + 0xC) + 0x10;
 
-	Warning("Failed to find RTTI Complete Object Locator for %s\n", name.c_str());
-	return nullptr;
+	return IsInSection(runTimeData, pszTypeName, decoratedTableName.size() + 1) && !memcmp(pszTypeName, decoratedTableName.c_str(), decoratedTableName.size() + 1);
 }
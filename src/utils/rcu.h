@@ -0,0 +1,137 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <atomic>
+#include <vector>
+
+// Minimal read-copy-update for data shared with hooks that can run outside the main thread.
+// Writers (main thread only) publish a new immutable object and retire the old one.
+// Readers only bump the counter of the current epoch around their critical section, they never lock or allocate.
+// Reclaim flips the epoch so new readers count against the other one, and once the old epoch's readers have all left
+// it frees what was retired before the flip. A steady stream of readers therefore never holds up reclamation for long.
+class CRcuDomain
+{
+public:
+	~CRcuDomain()
+	{
+		FreeAll(m_Pending);
+		FreeAll(m_Retired);
+	}
+
+	// Returns the epoch to pass to ExitRead
+	int EnterRead()
+	{
+		for (;;)
+		{
+			int iEpoch = m_iEpoch.load(std::memory_order_seq_cst);
+			m_nReaders[iEpoch].fetch_add(1, std::memory_order_seq_cst);
+
+			// If the epoch flipped in between, Reclaim might already have seen this epoch empty, so join the new one instead
+			if (m_iEpoch.load(std::memory_order_seq_cst) == iEpoch)
+				return iEpoch;
+
+			m_nReaders[iEpoch].fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void ExitRead(int iEpoch) { m_nReaders[iEpoch].fetch_sub(1, std::memory_order_release); }
+
+	template <class T>
+	void Retire(const T *pObject)
+	{
+		m_Retired.push_back({ (void *)pObject, [](void *p) { delete (const T *)p; } });
+	}
+
+	// Main thread only, should be called periodically
+	void Reclaim()
+	{
+		int iOldEpoch = m_iEpoch.load(std::memory_order_relaxed) ^ 1;
+
+		// Everything from before the last flip is waiting on readers that entered before it
+		if (m_nReaders[iOldEpoch].load(std::memory_order_seq_cst) != 0)
+			return;
+
+		FreeAll(m_Pending);
+
+		if (m_Retired.empty())
+			return;
+
+		m_Pending.swap(m_Retired);
+		m_iEpoch.store(iOldEpoch, std::memory_order_seq_cst);
+
+		// Readers are short, so the previous epoch is often already empty
+		if (m_nReaders[iOldEpoch ^ 1].load(std::memory_order_seq_cst) == 0)
+			FreeAll(m_Pending);
+	}
+
+private:
+	struct Retired_t
+	{
+		void *m_pObject;
+		void (*m_pfnDelete)(void *);
+	};
+
+	static void FreeAll(std::vector<Retired_t> &retired)
+	{
+		for (auto &entry : retired)
+			entry.m_pfnDelete(entry.m_pObject);
+
+		retired.clear();
+	}
+
+	std::atomic<int> m_iEpoch { 0 };
+	std::atomic<int> m_nReaders[2] {};
+	// Retired before the last flip, freed once the epoch before it is empty
+	std::vector<Retired_t> m_Pending;
+	std::vector<Retired_t> m_Retired;
+};
+
+inline CRcuDomain g_Rcu;
+
+class CRcuReadScope
+{
+public:
+	CRcuReadScope() : m_iEpoch(g_Rcu.EnterRead()) {}
+	~CRcuReadScope() { g_Rcu.ExitRead(m_iEpoch); }
+
+private:
+	int m_iEpoch;
+};
+
+// Pointer to an immutable object that is swapped atomically on publish.
+// Off the main thread, Get() must be called inside a CRcuReadScope and the result must not outlive it.
+template <class T>
+class CRcuPointer
+{
+public:
+	~CRcuPointer() { delete m_pCurrent.load(); }
+
+	const T *Get() const { return m_pCurrent.load(std::memory_order_seq_cst); }
+
+	// Main thread only
+	void Publish(const T *pNew)
+	{
+		if (const T *pOld = m_pCurrent.exchange(pNew, std::memory_order_seq_cst))
+			g_Rcu.Retire(pOld);
+	}
+
+private:
+	std::atomic<const T *> m_pCurrent { nullptr };
+};
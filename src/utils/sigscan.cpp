@@ -0,0 +1,278 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sigscan.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIGSCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIGSCAN_AVX2_TARGET
+#else
+#define SIGSCAN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "tier0/memdbgon.h"
+
+// How common a byte is in x86-64 code, 0 for anything not listed. Roughly in order of frequency in the game binaries:
+// padding and immediates, REX prefixes, movs, leas, calls, jumps, stack offsets, int3 padding...
+static const uint8_t s_CommonBytes[] =
+{
+	0x00, 0xFF, 0x48, 0x8B, 0x89, 0x0F, 0x24, 0x4C, 0x8D, 0xE8, 0x44, 0x83, 0x01, 0x45, 0xC0, 0x85,
+	0x74, 0x75, 0x49, 0x41, 0xCC, 0x90, 0x08, 0x10, 0x20, 0x18, 0x28, 0x30, 0x38, 0x40, 0x4D, 0xC3,
+	0x5C, 0x54, 0x84, 0xE9, 0xEB, 0x33, 0xC7, 0x02, 0x04, 0x80, 0xF8, 0x7C, 0x50, 0x58, 0x5B, 0x5D,
+};
+
+static int GetByteFrequency(uint8_t b)
+{
+	constexpr int nCommonBytes = sizeof(s_CommonBytes);
+
+	for (int i = 0; i < nCommonBytes; i++)
+	{
+		if (s_CommonBytes[i] == b)
+			return nCommonBytes - i;
+	}
+
+	return 0;
+}
+
+#ifdef SIGSCAN_X86
+static int CountTrailingZeros(uint32_t nMask)
+{
+#ifdef _MSC_VER
+	unsigned long iIndex;
+	_BitScanForward(&iIndex, nMask);
+	return (int)iIndex;
+#else
+	return __builtin_ctz(nMask);
+#endif
+}
+
+static bool CpuSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+
+	if (info[0] < 7)
+		return false;
+
+	// The OS has to save the AVX registers too
+	__cpuid(info, 1);
+
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static const bool s_bAVX2 = CpuSupportsAVX2();
+#endif
+
+CSignatureScanner::CSignatureScanner(const uint8_t *pSignature, size_t iSigLength, bool bAllowWildcard) :
+	m_pSignature(pSignature), m_iSigLength(iSigLength), m_bAllowWildcard(bAllowWildcard)
+{
+	// The rarest byte, then the rarest of the others
+	int iBest = -1;
+	int iSecond = -1;
+
+	for (size_t i = 0; i < m_iSigLength; i++)
+	{
+		if (IsWildcard(i))
+			continue;
+
+		int iFrequency = GetByteFrequency(m_pSignature[i]);
+
+		if (iBest == -1 || iFrequency < GetByteFrequency(m_pSignature[iBest]))
+		{
+			iSecond = iBest;
+			iBest = (int)i;
+		}
+		else if (iSecond == -1 || iFrequency < GetByteFrequency(m_pSignature[iSecond]))
+		{
+			iSecond = (int)i;
+		}
+	}
+
+	if (iBest == -1)
+		return;
+
+	m_bHasAnchor = true;
+	m_iAnchor1 = iBest;
+	m_iAnchor2 = iSecond == -1 ? iBest : iSecond;
+}
+
+bool CSignatureScanner::Matches(const uint8_t *p) const
+{
+	for (size_t i = 0; i < m_iSigLength; i++)
+	{
+		if (p[i] != m_pSignature[i] && !IsWildcard(i))
+			return false;
+	}
+
+	return true;
+}
+
+const uint8_t *CSignatureScanner::Find(const uint8_t *pStart, const uint8_t *pEnd) const
+{
+	if (pStart >= pEnd || (size_t)(pEnd - pStart) < m_iSigLength)
+		return nullptr;
+
+	const uint8_t *pLast = pEnd - m_iSigLength;
+
+	// Everything matches
+	if (!m_bHasAnchor)
+		return pStart;
+
+#ifdef SIGSCAN_X86
+	if (s_bAVX2)
+		return FindAVX2(pStart, pLast);
+
+	return FindSSE2(pStart, pLast);
+#else
+	return FindScalar(pStart, pLast);
+#endif
+}
+
+void CSignatureScanner::FindAll(const CSignatureScanner *pScanners, Result_t *pResults, size_t nScanners, const uint8_t *pStart, const uint8_t *pStartEnd, const uint8_t *pEnd)
+{
+	constexpr size_t nChunkSize = 64 * 1024;
+
+	size_t nUnresolved = nScanners;
+
+	for (size_t i = 0; i < nScanners; i++)
+		pResults[i] = Result_t();
+
+	pStartEnd = std::min(pStartEnd, pEnd);
+
+	for (const uint8_t *pChunk = pStart; pChunk < pStartEnd && nUnresolved; pChunk += std::min<size_t>(nChunkSize, pStartEnd - pChunk))
+	{
+		const uint8_t *pChunkEnd = pChunk + std::min<size_t>(nChunkSize, pStartEnd - pChunk);
+
+		for (size_t i = 0; i < nScanners; i++)
+		{
+			Result_t &result = pResults[i];
+
+			if (result.m_bMultiple)
+				continue;
+
+			// Only matches starting in this chunk, those can run into the next one
+			size_t nOverlap = pScanners[i].m_iSigLength ? pScanners[i].m_iSigLength - 1 : 0;
+			const uint8_t *pSearchEnd = pChunkEnd + std::min<size_t>(nOverlap, pEnd - pChunkEnd);
+			const uint8_t *pMatch = pChunk;
+
+			while ((pMatch = pScanners[i].Find(pMatch, pSearchEnd)))
+			{
+				if (!result.m_pMatch)
+				{
+					result.m_pMatch = pMatch++;
+					continue;
+				}
+
+				result.m_bMultiple = true;
+				nUnresolved--;
+				break;
+			}
+		}
+	}
+}
+
+const uint8_t *CSignatureScanner::FindScalar(const uint8_t *p, const uint8_t *pLast) const
+{
+	uint8_t nAnchor1 = m_pSignature[m_iAnchor1];
+	uint8_t nAnchor2 = m_pSignature[m_iAnchor2];
+
+	for (; p <= pLast; p++)
+	{
+		if (p[m_iAnchor1] == nAnchor1 && p[m_iAnchor2] == nAnchor2 && Matches(p))
+			return p;
+	}
+
+	return nullptr;
+}
+
+#ifdef SIGSCAN_X86
+// Each block tests 16 starting positions, the loads stay within the pattern's footprint of the last one so they never go past pEnd
+const uint8_t *CSignatureScanner::FindSSE2(const uint8_t *p, const uint8_t *pLast) const
+{
+	const __m128i anchor1 = _mm_set1_epi8((char)m_pSignature[m_iAnchor1]);
+	const __m128i anchor2 = _mm_set1_epi8((char)m_pSignature[m_iAnchor2]);
+
+	for (; pLast - p >= 15; p += 16)
+	{
+		__m128i block1 = _mm_loadu_si128((const __m128i *)(p + m_iAnchor1));
+		__m128i block2 = _mm_loadu_si128((const __m128i *)(p + m_iAnchor2));
+		uint32_t nMask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block1, anchor1), _mm_cmpeq_epi8(block2, anchor2)));
+
+		while (nMask)
+		{
+			const uint8_t *pCandidate = p + CountTrailingZeros(nMask);
+
+			if (Matches(pCandidate))
+				return pCandidate;
+
+			nMask &= nMask - 1;
+		}
+	}
+
+	return FindScalar(p, pLast);
+}
+
+SIGSCAN_AVX2_TARGET const uint8_t *CSignatureScanner::FindAVX2(const uint8_t *p, const uint8_t *pLast) const
+{
+	const __m256i anchor1 = _mm256_set1_epi8((char)m_pSignature[m_iAnchor1]);
+	const __m256i anchor2 = _mm256_set1_epi8((char)m_pSignature[m_iAnchor2]);
+
+	for (; pLast - p >= 31; p += 32)
+	{
+		__m256i block1 = _mm256_loadu_si256((const __m256i *)(p + m_iAnchor1));
+		__m256i block2 = _mm256_loadu_si256((const __m256i *)(p + m_iAnchor2));
+		uint32_t nMask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block1, anchor1), _mm256_cmpeq_epi8(block2, anchor2)));
+
+		while (nMask)
+		{
+			const uint8_t *pCandidate = p + CountTrailingZeros(nMask);
+
+			if (Matches(pCandidate))
+				return pCandidate;
+
+			nMask &= nMask - 1;
+		}
+	}
+
+	return FindSSE2(p, pLast);
+}
+#else
+const uint8_t *CSignatureScanner::FindSSE2(const uint8_t *p, const uint8_t *pLast) const
+{
+	return FindScalar(p, pLast);
+}
+
+const uint8_t *CSignatureScanner::FindAVX2(const uint8_t *p, const uint8_t *pLast) const
+{
+	return FindScalar(p, pLast);
+}
+#endif
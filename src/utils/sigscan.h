@@ -0,0 +1,70 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Finds byte patterns where 0x2A can stand for any byte, used by CModule::FindSignature and SignatureIterator.
+// Instead of trying a full match at every offset, the two rarest bytes of the pattern (going by how common they are in x86-64 code)
+// are looked for 32 or 16 positions at a time with AVX2 or SSE2, and only the positions where both are present get a full compare.
+// Other architectures and the last few positions of a range use a plain loop, the results are the same either way.
+class CSignatureScanner
+{
+public:
+	CSignatureScanner(const uint8_t *pSignature, size_t iSigLength, bool bAllowWildcard);
+
+	// The first match starting in [pStart, pEnd) which fits entirely before pEnd, nullptr if there's none
+	const uint8_t *Find(const uint8_t *pStart, const uint8_t *pEnd) const;
+
+	struct Result_t
+	{
+		const uint8_t *m_pMatch = nullptr; // First match
+		bool m_bMultiple = false;
+	};
+
+	// Finds every pattern in one pass over [pStart, pEnd), pResults has one entry per scanner.
+	// The range is walked in chunks small enough to stay in cache and each pattern still missing a result is looked for in every chunk,
+	// so the module is only read from memory once however many patterns there are. Patterns stop being looked for once they've matched twice.
+	static void FindAll(const CSignatureScanner *pScanners, Result_t *pResults, size_t nScanners, const uint8_t *pStart, const uint8_t *pEnd)
+	{
+		FindAll(pScanners, pResults, nScanners, pStart, pEnd, pEnd);
+	}
+
+	// Same, but only matches starting before pStartEnd count, so a range can be split up and each part searched separately
+	static void FindAll(const CSignatureScanner *pScanners, Result_t *pResults, size_t nScanners, const uint8_t *pStart, const uint8_t *pStartEnd, const uint8_t *pEnd);
+
+private:
+	bool IsWildcard(size_t i) const { return m_bAllowWildcard && m_pSignature[i] == 0x2A; }
+	bool Matches(const uint8_t *p) const;
+
+	// pLast is the last position a match can start at
+	const uint8_t *FindScalar(const uint8_t *p, const uint8_t *pLast) const;
+	const uint8_t *FindSSE2(const uint8_t *p, const uint8_t *pLast) const;
+	const uint8_t *FindAVX2(const uint8_t *p, const uint8_t *pLast) const;
+
+	const uint8_t *m_pSignature;
+	size_t m_iSigLength;
+	bool m_bAllowWildcard;
+
+	// Offsets of the bytes looked for first, no anchor means the pattern is all wildcards
+	bool m_bHasAnchor = false;
+	size_t m_iAnchor1 = 0;
+	size_t m_iAnchor2 = 0;
+};
@@ -0,0 +1,56 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "workerpool.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "tier0/memdbgon.h"
+
+CWorkerPool::CWorkerPool(int nThreads)
+{
+	if (nThreads <= 0)
+		nThreads = std::min((int)std::thread::hardware_concurrency(), k_nMaxThreads);
+
+	m_nThreads = std::max(nThreads, 1);
+}
+
+void CWorkerPool::Run(const std::vector<std::function<void()>> &tasks) const
+{
+	std::atomic<size_t> nNext { 0 };
+
+	auto worker = [&]()
+	{
+		for (size_t i = nNext++; i < tasks.size(); i = nNext++)
+			tasks[i]();
+	};
+
+	std::vector<std::thread> threads;
+	int nThreads = (int)std::min<size_t>(m_nThreads, tasks.size());
+
+	for (int i = 1; i < nThreads; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
@@ -0,0 +1,43 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024 Source2ZE, xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <functional>
+#include <vector>
+
+// Runs batches of independent tasks on a few threads, for work like scanning modules at load.
+// There are no long lived threads, each Run starts its own and joins them before returning.
+class CWorkerPool
+{
+public:
+	static constexpr int k_nMaxThreads = 4;
+
+	// Counts the calling thread, 0 picks one per core up to k_nMaxThreads
+	explicit CWorkerPool(int nThreads = 0);
+
+	int GetThreadCount() const { return m_nThreads; }
+
+	// Runs every task once and returns when they're all done, the calling thread runs tasks too.
+	// Tasks should only write to their own results so the outcome doesn't depend on which thread ran what.
+	void Run(const std::vector<std::function<void()>> &tasks) const;
+
+private:
+	int m_nThreads;
+};
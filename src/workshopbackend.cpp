@@ -0,0 +1,137 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "workshopbackend.h"
+#include "tier0/platform.h"
+#include <algorithm>
+
+#include "tier0/memdbgon.h"
+
+static CSteamWorkshopBackend s_SteamWorkshopBackend;
+IWorkshopBackend *g_pWorkshopBackend = &s_SteamWorkshopBackend;
+
+uint32 CSteamWorkshopBackend::GetItemState(PublishedFileId_t addon)
+{
+	ISteamUGC *pUGC = GetSteamUGC();
+
+	return pUGC ? pUGC->GetItemState(addon) : 0;
+}
+
+bool CSteamWorkshopBackend::GetItemInstallInfo(PublishedFileId_t addon, uint64 *pSizeOnDisk, uint32 *pTimeUpdated)
+{
+	ISteamUGC *pUGC = GetSteamUGC();
+	char szFolder[MAX_PATH];
+
+	return pUGC && pUGC->GetItemInstallInfo(addon, pSizeOnDisk, szFolder, sizeof(szFolder), pTimeUpdated);
+}
+
+bool CSteamWorkshopBackend::GetItemDownloadInfo(PublishedFileId_t addon, uint64 *pBytesDownloaded, uint64 *pBytesTotal)
+{
+	ISteamUGC *pUGC = GetSteamUGC();
+
+	return pUGC && pUGC->GetItemDownloadInfo(addon, pBytesDownloaded, pBytesTotal);
+}
+
+bool CSteamWorkshopBackend::DownloadItem(PublishedFileId_t addon)
+{
+	ISteamUGC *pUGC = GetSteamUGC();
+
+	return pUGC && pUGC->DownloadItem(addon, false);
+}
+
+bool CSteamWorkshopBackend::QueryItemDetails(const std::vector<PublishedFileId_t> &addons, WorkshopDetailsCallback_t callback)
+{
+	// Finished queries can't be freed from their own callback, so it's done here
+	m_Queries.erase(std::remove_if(m_Queries.begin(), m_Queries.end(), [](const std::unique_ptr<Query_t> &pQuery) { return pQuery->m_bDone; }), m_Queries.end());
+
+	ISteamUGC *pUGC = GetSteamUGC();
+
+	if (!pUGC)
+		return false;
+
+	bool bSent = false;
+
+	// A details request returns at most a page of results
+	for (size_t i = 0; i < addons.size(); i += kNumUGCResultsPerPage)
+	{
+		auto pQuery = std::make_unique<Query_t>();
+		pQuery->m_Addons.assign(addons.begin() + i, addons.begin() + std::min(i + kNumUGCResultsPerPage, addons.size()));
+
+		UGCQueryHandle_t hQuery = pUGC->CreateQueryUGCDetailsRequest(pQuery->m_Addons.data(), (uint32)pQuery->m_Addons.size());
+
+		if (hQuery == k_UGCQueryHandleInvalid)
+			continue;
+
+		SteamAPICall_t hCall = pUGC->SendQueryUGCRequest(hQuery);
+
+		if (hCall == k_uAPICallInvalid)
+		{
+			pUGC->ReleaseQueryUGCRequest(hQuery);
+			continue;
+		}
+
+		pQuery->m_Callback = callback;
+		pQuery->m_CallResult.Set(hCall, pQuery.get(), &Query_t::OnCompleted);
+		m_Queries.push_back(std::move(pQuery));
+
+		bSent = true;
+	}
+
+	return bSent;
+}
+
+void CSteamWorkshopBackend::Query_t::OnCompleted(SteamUGCQueryCompleted_t *pResult, bool bIOFailure)
+{
+	m_bDone = true;
+
+	std::vector<WorkshopItemDetails_t> details;
+	details.reserve(m_Addons.size());
+
+	for (PublishedFileId_t addon : m_Addons)
+		details.push_back({ addon, false, 0 });
+
+	ISteamUGC *pUGC = GetSteamUGC();
+
+	if (!pUGC)
+		return;
+
+	if (!bIOFailure && pResult->m_eResult == k_EResultOK)
+	{
+		for (uint32 i = 0; i < pResult->m_unNumResultsReturned; i++)
+		{
+			SteamUGCDetails_t ugcDetails;
+
+			if (!pUGC->GetQueryUGCResult(pResult->m_handle, i, &ugcDetails) || ugcDetails.m_eResult != k_EResultOK)
+				continue;
+
+			for (WorkshopItemDetails_t &item : details)
+			{
+				if (item.m_nAddon == ugcDetails.m_nPublishedFileId)
+				{
+					item.m_bFound = true;
+					item.m_nTimeUpdated = ugcDetails.m_rtimeUpdated;
+				}
+			}
+		}
+	}
+
+	pUGC->ReleaseQueryUGCRequest(pResult->m_handle);
+
+	m_Callback(details);
+}
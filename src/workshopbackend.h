@@ -0,0 +1,88 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "steam/steam_api_common.h"
+#include "steam/isteamugc.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Defined in multiaddonmanager.cpp
+ISteamUGC *GetSteamUGC();
+
+struct WorkshopItemDetails_t
+{
+	PublishedFileId_t m_nAddon;
+	bool m_bFound; // False if the item doesn't exist or the query for it failed
+	uint32 m_nTimeUpdated; // Unix time of the latest version on the workshop
+};
+
+using WorkshopDetailsCallback_t = std::function<void(const std::vector<WorkshopItemDetails_t> &details)>;
+
+// Everything the plugin needs from the workshop. Steam's is the one used for real, keeping it behind an interface
+// lets the logic on top of it run against a fake one.
+// Main thread only
+class IWorkshopBackend
+{
+public:
+	virtual ~IWorkshopBackend() = default;
+
+	// Whether the UGC interface is there at all, nothing else works until it is
+	virtual bool IsAvailable() = 0;
+
+	// EItemState flags
+	virtual uint32 GetItemState(PublishedFileId_t addon) = 0;
+	virtual bool GetItemInstallInfo(PublishedFileId_t addon, uint64 *pSizeOnDisk, uint32 *pTimeUpdated) = 0;
+	virtual bool GetItemDownloadInfo(PublishedFileId_t addon, uint64 *pBytesDownloaded, uint64 *pBytesTotal) = 0;
+
+	// Completion is reported through the DownloadItemResult_t callback
+	virtual bool DownloadItem(PublishedFileId_t addon) = 0;
+
+	// Look up the details of many items with as few requests as possible. The callback runs later, once for each batch of items
+	// with one entry per item of that batch. Returns false if no request could be sent
+	virtual bool QueryItemDetails(const std::vector<PublishedFileId_t> &addons, WorkshopDetailsCallback_t callback) = 0;
+};
+
+class CSteamWorkshopBackend : public IWorkshopBackend
+{
+public:
+	bool IsAvailable() override { return GetSteamUGC() != nullptr; }
+	uint32 GetItemState(PublishedFileId_t addon) override;
+	bool GetItemInstallInfo(PublishedFileId_t addon, uint64 *pSizeOnDisk, uint32 *pTimeUpdated) override;
+	bool GetItemDownloadInfo(PublishedFileId_t addon, uint64 *pBytesDownloaded, uint64 *pBytesTotal) override;
+	bool DownloadItem(PublishedFileId_t addon) override;
+	bool QueryItemDetails(const std::vector<PublishedFileId_t> &addons, WorkshopDetailsCallback_t callback) override;
+
+private:
+	struct Query_t
+	{
+		std::vector<PublishedFileId_t> m_Addons;
+		WorkshopDetailsCallback_t m_Callback;
+		CCallResult<Query_t, SteamUGCQueryCompleted_t> m_CallResult;
+		bool m_bDone = false;
+
+		void OnCompleted(SteamUGCQueryCompleted_t *pResult, bool bIOFailure);
+	};
+
+	std::vector<std::unique_ptr<Query_t>> m_Queries;
+};
+
+extern IWorkshopBackend *g_pWorkshopBackend;
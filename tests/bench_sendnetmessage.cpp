@@ -0,0 +1,121 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "clientindex.h"
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+// Times the per-message fast path of Hook_SendNetMessage: the message ID compare and the per-slot activity store.
+// Run by hand, e.g. after touching CClientIndex or the hook, it isn't part of the test run.
+
+// net_SignonState in networkbasetypes.proto, the only message the hook does more work for
+static constexpr int k_nSignonStateId = 7;
+
+// Stands in for NetMessageInfo_t, the hook only reads the ID
+struct BenchMessageInfo_t
+{
+	int m_MessageId;
+};
+
+CClientIndex g_ClientIndex;
+std::atomic<double> g_flFrameTime {};
+
+// Same shape as the hook up to the point it calls the original function
+static int SendNetMessageFastPath(CPlayerSlot slot, const BenchMessageInfo_t *info)
+{
+	if (info->m_MessageId != k_nSignonStateId)
+	{
+		g_ClientIndex.SetLastActiveTime(slot, g_flFrameTime.load(std::memory_order_relaxed));
+		return 1;
+	}
+
+	return 0;
+}
+
+// Sends nMessages to the slots in [iFirstSlot, iFirstSlot + nSlots), returns how many took the fast path
+static int SendMessages(int iFirstSlot, int nSlots, int nMessages)
+{
+	// Mostly entity and user messages with an occasional signon message, like a client that's in game
+	std::vector<BenchMessageInfo_t> messages;
+	for (int i = 0; i < 1024; i++)
+		messages.push_back({ i % 256 == 0 ? k_nSignonStateId : 40 + i % 32 });
+
+	int nFastPath = 0;
+	for (int i = 0; i < nMessages; i++)
+		nFastPath += SendNetMessageFastPath(CPlayerSlot(iFirstSlot + i % nSlots), &messages[i % messages.size()]);
+
+	return nFastPath;
+}
+
+static void RunBenchmark(const char *pszName, int nThreads, int nMessagesPerThread)
+{
+	int nSlotsPerThread = CClientIndex::k_nMaxSlots / nThreads;
+	std::vector<int> fastPathCounts(nThreads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nThreads; i++)
+	{
+		threads.emplace_back([&, i]() {
+			fastPathCounts[i] = SendMessages(i * nSlotsPerThread, nSlotsPerThread, nMessagesPerThread);
+		});
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	double flSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int nFastPath = 0;
+	for (int nCount : fastPathCounts)
+		nFastPath += nCount;
+
+	// Wall time over all messages, so with enough cores more threads should bring this down unless they contend
+	int nMessages = nThreads * nMessagesPerThread;
+	printf("%-16s %2i thread(s) %10i messages %8.2f ns/message (%i fast path)\n", pszName, nThreads, nMessages, flSeconds * 1e9 / nMessages,
+		   nFastPath);
+}
+
+int main()
+{
+	const int nMessagesPerThread = 50'000'000;
+
+	g_flFrameTime = 1.0;
+
+	RunBenchmark("SendNetMessage", 1, nMessagesPerThread);
+
+	// The hook runs on the network threads, each sending to its own clients
+	RunBenchmark("SendNetMessage", 4, nMessagesPerThread);
+
+	// The activity time has to have been written for every slot that was sent to
+	for (int i = 0; i < CClientIndex::k_nMaxSlots; i++)
+	{
+		if (g_ClientIndex.GetLastActiveTime(CPlayerSlot(i)) != 1.0)
+		{
+			printf("Slot %i was never marked active\n", i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "workshopbackend.h"
+#include <unordered_map>
+
+// A workshop that only exists in memory. Items are set up by the test, downloads are recorded and can be made to fail
+class CFakeWorkshopBackend : public IWorkshopBackend
+{
+public:
+	struct Item_t
+	{
+		uint32 m_nState = 0; // EItemState flags
+		uint64 m_nSizeOnDisk = 0;
+		uint32 m_nTimeUpdated = 0;
+		int m_nFailedStarts = 0; // How many more DownloadItem calls fail before one works
+	};
+
+	bool IsAvailable() override { return m_bAvailable; }
+
+	uint32 GetItemState(PublishedFileId_t addon) override
+	{
+		auto it = m_Items.find(addon);
+		return it != m_Items.end() ? it->second.m_nState : 0;
+	}
+
+	bool GetItemInstallInfo(PublishedFileId_t addon, uint64 *pSizeOnDisk, uint32 *pTimeUpdated) override
+	{
+		auto it = m_Items.find(addon);
+
+		if (it == m_Items.end() || !(it->second.m_nState & k_EItemStateInstalled))
+			return false;
+
+		*pSizeOnDisk = it->second.m_nSizeOnDisk;
+		*pTimeUpdated = it->second.m_nTimeUpdated;
+		return true;
+	}
+
+	bool GetItemDownloadInfo(PublishedFileId_t, uint64 *, uint64 *) override { return false; }
+
+	bool DownloadItem(PublishedFileId_t addon) override
+	{
+		m_DownloadRequests.push_back(addon);
+
+		Item_t &item = m_Items[addon];
+
+		if (item.m_nFailedStarts > 0)
+		{
+			item.m_nFailedStarts--;
+			return false;
+		}
+
+		item.m_nState |= k_EItemStateDownloading;
+		return true;
+	}
+
+	bool QueryItemDetails(const std::vector<PublishedFileId_t> &addons, WorkshopDetailsCallback_t callback) override
+	{
+		std::vector<WorkshopItemDetails_t> details;
+
+		for (PublishedFileId_t addon : addons)
+		{
+			auto it = m_Items.find(addon);
+			details.push_back({ addon, it != m_Items.end(), it != m_Items.end() ? it->second.m_nTimeUpdated : 0 });
+		}
+
+		callback(details);
+		return true;
+	}
+
+	bool m_bAvailable = true;
+	std::unordered_map<PublishedFileId_t, Item_t> m_Items;
+	std::vector<PublishedFileId_t> m_DownloadRequests; // Every DownloadItem call in order, including the failed ones
+};
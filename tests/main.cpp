@@ -0,0 +1,50 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "test.h"
+
+int g_nFailedChecks = 0;
+
+std::vector<TestCase_t> &GetTestCases()
+{
+	static std::vector<TestCase_t> s_TestCases;
+	return s_TestCases;
+}
+
+int main()
+{
+	int nFailedTests = 0;
+
+	for (const TestCase_t &test : GetTestCases())
+	{
+		int nFailedBefore = g_nFailedChecks;
+		test.m_pFunc();
+
+		bool bPassed = g_nFailedChecks == nFailedBefore;
+		printf("[%s] %s\n", bPassed ? " OK " : "FAIL", test.m_pszName);
+
+		if (!bPassed)
+			nFailedTests++;
+	}
+
+	printf("%i of %i tests passed\n", (int)GetTestCases().size() - nFailedTests, (int)GetTestCases().size());
+
+	return nFailedTests ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+// Just enough of a test runner for logic that doesn't need the engine. TEST registers a test, CHECK reports a failure and carries on
+using TestFunc_t = void (*)();
+
+struct TestCase_t
+{
+	const char *m_pszName;
+	TestFunc_t m_pFunc;
+};
+
+std::vector<TestCase_t> &GetTestCases();
+extern int g_nFailedChecks;
+
+struct CTestRegistrar
+{
+	CTestRegistrar(const char *pszName, TestFunc_t pFunc) { GetTestCases().push_back({ pszName, pFunc }); }
+};
+
+#define TEST(name) \
+	static void Test_##name(); \
+	static CTestRegistrar s_TestRegistrar_##name(#name, &Test_##name); \
+	static void Test_##name()
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			g_nFailedChecks++; \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
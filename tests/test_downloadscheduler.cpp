@@ -0,0 +1,110 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "test.h"
+#include "fakeworkshopbackend.h"
+#include "downloadscheduler.h"
+
+static const DownloadRetryPolicy_t k_RetryPolicy = { 2, 5.0 };
+
+TEST(FailedStartIsRetriedWithBackoff)
+{
+	CFakeWorkshopBackend backend;
+	backend.m_Items[1].m_nFailedStarts = 2;
+
+	CDownloadScheduler downloads;
+	downloads.Queue(1, true, 0.0);
+
+	std::vector<DownloadEvent_t> events;
+	downloads.StartQueued(&backend, 4, k_RetryPolicy, 0.0, events);
+
+	CHECK(events.size() == 1 && events[0].m_eEvent == EDownloadEvent::Retrying);
+	CHECK(events[0].m_flRetryDelay >= 2.5 && events[0].m_flRetryDelay <= 5.0);
+
+	// Nothing starts before the retry time
+	events.clear();
+	downloads.StartQueued(&backend, 4, k_RetryPolicy, 1.0, events);
+	CHECK(events.empty());
+
+	// The second delay is doubled
+	events.clear();
+	downloads.StartQueued(&backend, 4, k_RetryPolicy, 10.0, events);
+	CHECK(events.size() == 1 && events[0].m_eEvent == EDownloadEvent::Retrying && events[0].m_Item.m_nAttempts == 2);
+	CHECK(events[0].m_flRetryDelay >= 5.0 && events[0].m_flRetryDelay <= 10.0);
+
+	events.clear();
+	downloads.StartQueued(&backend, 4, k_RetryPolicy, 30.0, events);
+	CHECK(events.size() == 1 && events[0].m_eEvent == EDownloadEvent::Started && events[0].m_Item.m_nAttempts == 3);
+	CHECK(downloads.CountInFlight() == 1);
+	CHECK(downloads.CountImportant() == 1);
+	CHECK(backend.m_DownloadRequests.size() == 3);
+}
+
+TEST(OutOfAttemptsIsRemoved)
+{
+	CFakeWorkshopBackend backend;
+	backend.m_Items[1].m_nFailedStarts = 100;
+
+	CDownloadScheduler downloads;
+	downloads.Queue(1, true, 0.0);
+
+	// Without retries the first failure is the last, and it must still report the important item so a pending reload goes ahead
+	std::vector<DownloadEvent_t> events;
+	downloads.StartQueued(&backend, 4, { 0, 5.0 }, 0.0, events);
+
+	CHECK(events.size() == 1 && events[0].m_eEvent == EDownloadEvent::GaveUp);
+	CHECK(events[0].m_Item.m_nAddon == 1 && events[0].m_Item.m_bImportant);
+	CHECK(downloads.Count() == 0);
+	CHECK(downloads.CountImportant() == 0);
+}
+
+TEST(RetryGivesUpAfterPolicy)
+{
+	CDownloadScheduler downloads;
+	downloads.Queue(1, false, 0.0);
+	downloads.Find(1)->m_nAttempts = k_RetryPolicy.m_nMaxRetries + 1;
+
+	double flDelay = -1.0;
+	CHECK(!downloads.Retry(1, k_RetryPolicy, 0.0, flDelay));
+	CHECK(flDelay == -1.0);
+	CHECK(downloads.Find(1) != nullptr);
+
+	// Long outages don't push retries out forever
+	downloads.Find(1)->m_nAttempts = 20;
+	CHECK(downloads.Retry(1, { 100, 5.0 }, 0.0, flDelay));
+	CHECK(flDelay >= 150.0 && flDelay <= 300.0);
+}
+
+TEST(StartsImportantFirstUpToLimit)
+{
+	CFakeWorkshopBackend backend;
+	CDownloadScheduler downloads;
+	downloads.Queue(1, false, 0.0);
+	downloads.Queue(2, false, 0.0);
+	downloads.Queue(3, true, 0.0);
+
+	std::vector<DownloadEvent_t> events;
+	downloads.StartQueued(&backend, 2, k_RetryPolicy, 0.0, events);
+
+	CHECK(events.size() == 2);
+	CHECK(backend.m_DownloadRequests.size() == 2 && backend.m_DownloadRequests[0] == 3 && backend.m_DownloadRequests[1] == 1);
+	CHECK(downloads.CountInFlight() == 2);
+	CHECK(downloads.Find(2)->m_eState == EDownloadState::Queued);
+}
@@ -0,0 +1,103 @@
+/**
+ * =============================================================================
+ * MultiAddonManager
+ * Copyright (C) 2024-2025 xen
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "test.h"
+#include "fakeworkshopbackend.h"
+#include "downloadscheduler.h"
+#include "mountmanifest.h"
+
+static const char *k_pszManifestPath = "multiaddonmanager_test_mounted.txt";
+
+static CMountManifest MakeManifest()
+{
+	CMountManifest manifest;
+	manifest.Add({ 1, false, 1000, 111, "steamapps/workshop/content/730/1/1.vpk" });
+	manifest.Add({ 2, true, 2000, 222, "steamapps/workshop/content/730/2/2.vpk" });
+	manifest.Add({ 3, false, 3000, 333, "steamapps/workshop/content/730/3/3.vpk" });
+	return manifest;
+}
+
+TEST(ManifestRoundTrip)
+{
+	CMountManifest written = MakeManifest();
+	CHECK(written.Write(k_pszManifestPath));
+
+	CMountManifest read;
+	CHECK(read.Read(k_pszManifestPath));
+	remove(k_pszManifestPath);
+
+	CHECK(read.GetEntries().size() == 3);
+
+	for (const MountManifestEntry_t &entry : written.GetEntries())
+	{
+		const MountManifestEntry_t *pRead = read.Find(entry.m_nAddon);
+
+		CHECK(pRead && pRead->m_bLegacy == entry.m_bLegacy && pRead->m_nSize == entry.m_nSize
+			&& pRead->m_nModifiedTime == entry.m_nModifiedTime && pRead->m_sPath == entry.m_sPath);
+	}
+
+	CHECK(MountManifestEntry_t::GetCheckPath("a/1.vpk", false) == "a/1_dir.vpk");
+	CHECK(MountManifestEntry_t::GetCheckPath("a/1.vpk", true) == "a/1.vpk");
+}
+
+TEST(ManifestMountsUnchangedPrefixOnly)
+{
+	CMountManifest manifest = MakeManifest();
+	auto unchanged = [](const MountManifestEntry_t &) { return true; };
+
+	CHECK(manifest.CountMountable({ 1, 2, 3 }, unchanged) == 3);
+
+	// Mounting 3 without 4 under it would put it in the wrong place
+	CHECK(manifest.CountMountable({ 1, 4, 3 }, unchanged) == 1);
+
+	CHECK(manifest.CountMountable({ 1, 2, 3 }, [](const MountManifestEntry_t &entry) { return entry.m_nAddon != 2; }) == 1);
+	CHECK(manifest.CountMountable({}, unchanged) == 0);
+}
+
+// What RefreshAddons does with addons mounted from the manifest once Steam is up
+TEST(ManifestAddonsCheckedOnceSteamIsUp)
+{
+	CFakeWorkshopBackend backend;
+	backend.m_Items[1].m_nState = k_EItemStateInstalled;
+	backend.m_Items[2].m_nState = k_EItemStateInstalled | k_EItemStateNeedsUpdate;
+	backend.m_Items[3].m_nState = k_EItemStateInstalled | k_EItemStateLegacyItem;
+
+	CHECK(CMountManifest::Check(&backend, 1) == EManifestAddonState::Current);
+	CHECK(CMountManifest::Check(&backend, 2) == EManifestAddonState::NeedsUpdate);
+	CHECK(CMountManifest::Check(&backend, 3) == EManifestAddonState::Stale);
+	CHECK(CMountManifest::Check(&backend, 4) == EManifestAddonState::Stale);
+
+	// The update is downloaded through the same queue as everything else
+	CDownloadScheduler downloads;
+	CMountManifest manifest = MakeManifest();
+
+	for (const MountManifestEntry_t &entry : manifest.GetEntries())
+	{
+		if (CMountManifest::Check(&backend, entry.m_nAddon) == EManifestAddonState::NeedsUpdate)
+			downloads.Queue(entry.m_nAddon, true, 0.0);
+	}
+
+	std::vector<DownloadEvent_t> events;
+	downloads.StartQueued(&backend, 4, { 2, 5.0 }, 0.0, events);
+
+	CHECK(events.size() == 1 && events[0].m_eEvent == EDownloadEvent::Started && events[0].m_Item.m_nAddon == 2);
+	CHECK(backend.m_DownloadRequests.size() == 1 && backend.m_DownloadRequests[0] == 2);
+	CHECK(backend.GetItemState(2) & k_EItemStateDownloading);
+}